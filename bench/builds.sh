@@ -0,0 +1,22 @@
+#!/bin/bash
+#Builds the shell as debug (the default flags), release (-O2 -flto) and PGO,
+#and runs bench/microbench against each build. Each build's JSON goes to
+#bench/results/<build>.json so the three can be diffed.
+#
+#usage: bench/builds.sh [build ...]    (default: debug release pgo)
+
+set -e
+cd "$(dirname "$0")/.."
+builds=${*:-debug release pgo}
+mkdir -p bench/results
+
+for build in $builds; do
+    echo "== $build" >&2
+    case $build in
+        debug)   make clean > /dev/null && make simsh3 bench/stamp bench/microbench > /dev/null ;;
+        release) make release > /dev/null ;;
+        pgo)     make pgo > /dev/null ;;
+        *)       echo "unknown build $build" >&2; exit 1 ;;
+    esac
+    bench/microbench ./simsh3 | tee "bench/results/$build.json"
+done
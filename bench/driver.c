@@ -0,0 +1,176 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "driver.h"
+
+long long now_ns( void )
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (long long) now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+//Reads the shell's output until the prompt comes back
+static int wait_for_prompt( int fd )
+{
+    const char * prompt = "mysh: ";
+    size_t matched = 0;
+    char c;
+
+    while( read( fd, &c, 1 ) == 1 ) {
+        if( c == prompt[ matched ] ) {
+            matched++;
+            if( prompt[ matched ] == '\0' )
+                return 0;
+        }
+        else {
+            matched = ( c == prompt[ 0 ] ) ? 1 : 0;
+        }
+    }
+    return -1;
+}
+
+int shell_start( const char * shell, shell_proc_t * proc )
+{
+    int to_shell[ 2 ];
+    int from_shell[ 2 ];
+
+    strcpy( proc->stamp_path, "/tmp/simsh-stampsXXXXXX" );
+    int stamp_fd = mkstemp( proc->stamp_path );
+    if( stamp_fd == -1 ) {
+        perror( "mkstemp" );
+        return -1;
+    }
+    close( stamp_fd );
+    setenv( "SIMSH_BENCH_STAMPS", proc->stamp_path, 1 );
+
+    if( pipe( to_shell ) == -1 || pipe( from_shell ) == -1 ) {
+        perror( "pipe" );
+        return -1;
+    }
+    proc->pid = fork();
+    if( proc->pid == 0 ) {
+        dup2( to_shell[ 0 ], STDIN_FILENO );
+        dup2( from_shell[ 1 ], STDOUT_FILENO );
+        close( to_shell[ 0 ] );
+        close( to_shell[ 1 ] );
+        close( from_shell[ 0 ] );
+        close( from_shell[ 1 ] );
+        execl( shell, shell, (char *) NULL );
+        perror( "execl" );
+        exit( 1 );
+    }
+    close( to_shell[ 0 ] );
+    close( from_shell[ 1 ] );
+    proc->to_shell = to_shell[ 1 ];
+    proc->from_shell = from_shell[ 0 ];
+    if( wait_for_prompt( proc->from_shell ) != 0 ) {
+        fprintf( stderr, "%s: no prompt\n", shell );
+        return -1;
+    }
+    return 0;
+}
+
+long long shell_run_line( shell_proc_t * proc, const char * line )
+{
+    long long enter;
+    size_t len = strlen( line );
+
+    if( write( proc->to_shell, line, len ) != (ssize_t) len )
+        return -1;
+    enter = now_ns();
+    if( write( proc->to_shell, "\n", 1 ) != 1 )
+        return -1;
+    if( wait_for_prompt( proc->from_shell ) != 0 ) {
+        fprintf( stderr, "shell exited early\n" );
+        return -1;
+    }
+    return enter;
+}
+
+void shell_stop( shell_proc_t * proc )
+{
+    if( write( proc->to_shell, "exit\n", 5 ) != 5 )
+        kill( proc->pid, SIGTERM );
+    close( proc->to_shell );
+    close( proc->from_shell );
+    waitpid( proc->pid, NULL, 0 );
+    unlink( proc->stamp_path );
+}
+
+//Latest CLOCK_MONOTONIC time written by the bench/stamp stages
+static long long latest_stamp( const char * path )
+{
+    FILE * f = fopen( path, "r" );
+    long long latest = 0;
+    long long stamp;
+
+    if( f == NULL )
+        return -1;
+    while( fscanf( f, "%lld", &stamp ) == 1 ) {
+        if( stamp > latest )
+            latest = stamp;
+    }
+    fclose( f );
+    return latest;
+}
+
+int pipeline_startup( shell_proc_t * proc, int stages, double * samples, int iterations )
+{
+    const char * stage_cmd = "bench/stamp";
+    char * line;
+    int i;
+
+    line = ( char * ) malloc( (size_t) stages * ( strlen( stage_cmd ) + 3 ) + 1 );
+    line[ 0 ] = '\0';
+    for( i = 0; i < stages; i++ ) {
+        if( i > 0 )
+            strcat( line, " | " );
+        strcat( line, stage_cmd );
+    }
+
+    for( i = 0; i < iterations; i++ ) {
+        long long enter;
+        if( truncate( proc->stamp_path, 0 ) == -1 ) {
+            perror( "truncate" );
+            break;
+        }
+        enter = shell_run_line( proc, line );
+        if( enter == -1 )
+            break;
+        samples[ i ] = ( latest_stamp( proc->stamp_path ) - enter ) / 1000.0;
+    }
+    free( line );
+    return ( i == iterations ) ? 0 : -1;
+}
+
+static int compare_double( const void * a, const void * b )
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return ( x > y ) - ( x < y );
+}
+
+void bench_print_json( const bench_result_t * results, int num_results )
+{
+    int i;
+
+    printf( "{\n  \"benchmarks\": [\n" );
+    for( i = 0; i < num_results; i++ ) {
+        const bench_result_t * r = &results[ i ];
+        qsort( r->samples, r->num_samples, sizeof( double ), compare_double );
+        printf( "    {\"name\": \"%s\", \"unit\": \"%s\", \"iterations\": %ld, "
+                "\"min\": %.1f, \"median\": %.1f, \"max\": %.1f}%s\n",
+                r->name, r->unit, r->iterations,
+                r->samples[ 0 ], r->samples[ r->num_samples / 2 ],
+                r->samples[ r->num_samples - 1 ],
+                ( i == num_results - 1 ) ? "" : "," );
+    }
+    printf( "  ]\n}\n" );
+}
@@ -0,0 +1,52 @@
+#if !defined( __driver_h )
+#define __driver_h 1
+
+/* Helpers shared by the benchmarks that drive a shell over a pipe */
+
+typedef struct {
+    int pid;
+    int to_shell;    //write end of the shell's stdin
+    int from_shell;  //read end of the shell's stdout
+    char stamp_path[ 32 ];  //$SIMSH_BENCH_STAMPS for bench/stamp stages
+} shell_proc_t;
+
+/* now_ns(): CLOCK_MONOTONIC in nanoseconds */
+long long now_ns( void );
+
+/* shell_start(): runs shell with its stdin/stdout on pipes and a fresh
+ * stamp file in its environment, waits for the first prompt
+ * return value: 0 on success, -1 after printing an error
+ */
+int shell_start( const char * shell, shell_proc_t * proc );
+
+/* shell_run_line(): sends line (without its newline), then the newline, and
+ * waits for the next prompt
+ * return value: time in ns at which the newline was written, -1 on error
+ */
+long long shell_run_line( shell_proc_t * proc, const char * line );
+
+/* shell_stop(): sends exit and reaps the shell */
+void shell_stop( shell_proc_t * proc );
+
+/* pipeline_startup(): runs "bench/stamp | ... | bench/stamp" with the given
+ * number of stages, iterations times. Each stamp records when it started;
+ * the latest stamp minus the moment the newline was written is one sample,
+ * in microseconds, of the time from Enter until every stage was exec'd.
+ * return value: 0 on success, -1 after printing an error
+ */
+int pipeline_startup( shell_proc_t * proc, int stages, double * samples, int iterations );
+
+/* Results are printed as one JSON document with a fixed key order and
+ * precision, so two runs can be diffed line by line.
+ */
+typedef struct {
+    const char * name;
+    const char * unit;
+    long iterations;
+    double * samples;  //per-operation cost of each repetition
+    int num_samples;
+} bench_result_t;
+
+void bench_print_json( const bench_result_t * results, int num_results );
+
+#endif /* __driver_h */
@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../chop_line.h"
+#include "../parse.h"
+#include "../simsh.h"
+#include "driver.h"
+
+//Micro-benchmarks for the tokenizer, the parser, a loop run by the script VM
+//against the same body fed in line by line, a single launch through the
+//shell and the startup of a 20-stage pipeline. Prints one JSON document
+//(see driver.h) meant to be diffed across builds.
+//
+//usage: microbench [shell]
+
+#define REPETITIONS 31
+#define BATCH 20000
+#define SPAWN_ITERATIONS 200
+#define PIPELINE_STAGES 20
+#define PIPELINE_ITERATIONS 50
+#define LOOP_ITERATIONS 1000
+
+static const char* bench_line =
+    "run --cpu=1 cat < input.txt | grep -v skip 2>&1 | sort -k 2 | uniq -c > out.txt";
+
+long long tokenizeBatch(void){
+    long long start = now_ns();
+    int i;
+    for(i = 0; i < BATCH; i++){
+        free_chopped_line(get_chopped_line(bench_line));
+    }
+    return now_ns() - start;
+}
+
+long long parseBatch(chopped_line_t* chop_cmd){
+    char error[256];
+    long long start = now_ns();
+    int i;
+    for(i = 0; i < BATCH; i++){
+        freeCmd(processCmd(chop_cmd, PARSE_REDIRECT | PARSE_PIPE, error, sizeof(error)));
+    }
+    return now_ns() - start;
+}
+
+//The loop body only assigns, so both script cases time the interpreter
+//rather than fork()
+static const char* loop_body = "x=$i; case $i in *5) y=$x ;; *) y=none ;; esac";
+
+long long scriptLoop(simsh_ctx_t* ctx, const char* script){
+    simsh_result_t result;
+    long long start = now_ns();
+    simsh_run_line(ctx, script, &result);
+    return now_ns() - start;
+}
+
+long long scriptUnrolled(simsh_ctx_t* ctx){
+    simsh_result_t result;
+    char line[256];
+    long long start = now_ns();
+    int i;
+    for(i = 0; i < LOOP_ITERATIONS; i++){
+        snprintf(line, sizeof(line), "i=%d; %s", i, loop_body);
+        simsh_run_line(ctx, line, &result);
+    }
+    return now_ns() - start;
+}
+
+int main(int argc, char* argv[]){
+    const char* shell = (argc > 1) ? argv[1] : "./simsh3";
+    double tokenize_samples[REPETITIONS];
+    double parse_samples[REPETITIONS];
+    double spawn_samples[SPAWN_ITERATIONS];
+    double pipeline_samples[PIPELINE_ITERATIONS];
+    double loop_samples[REPETITIONS];
+    double unrolled_samples[REPETITIONS];
+    int i;
+
+    for(i = 0; i < REPETITIONS; i++){
+        tokenize_samples[i] = (double) tokenizeBatch() / BATCH;
+    }
+
+    chopped_line_t* chop_cmd = get_chopped_line(bench_line);
+    for(i = 0; i < REPETITIONS; i++){
+        parse_samples[i] = (double) parseBatch(chop_cmd) / BATCH;
+    }
+    free_chopped_line(chop_cmd);
+
+    //for i in 0 1 2 ...; do BODY; done, compiled once per run
+    size_t script_size = strlen(loop_body) + 8 * LOOP_ITERATIONS + 64;
+    char* script = (char*) malloc(script_size);
+    size_t len = snprintf(script, script_size, "for i in");
+    for(i = 0; i < LOOP_ITERATIONS; i++){
+        len += snprintf(script + len, script_size - len, " %d", i);
+    }
+    snprintf(script + len, script_size - len, "; do %s; done", loop_body);
+    simsh_ctx_t* ctx = simsh_ctx_create();
+    for(i = 0; i < REPETITIONS; i++){
+        loop_samples[i] = (double) scriptLoop(ctx, script) / LOOP_ITERATIONS;
+        unrolled_samples[i] = (double) scriptUnrolled(ctx) / LOOP_ITERATIONS;
+    }
+    simsh_ctx_destroy(ctx);
+    free(script);
+
+    //Enter to prompt for a single external command
+    shell_proc_t proc;
+    if(shell_start(shell, &proc) != 0) return 1;
+    for(i = 0; i < SPAWN_ITERATIONS; i++){
+        long long enter = shell_run_line(&proc, "true");
+        if(enter == -1) return 1;
+        spawn_samples[i] = (now_ns() - enter) / 1000.0;
+    }
+    if(pipeline_startup(&proc, PIPELINE_STAGES, pipeline_samples, PIPELINE_ITERATIONS) != 0) return 1;
+    shell_stop(&proc);
+
+    bench_result_t results[] = {
+        { "tokenize", "ns", BATCH, tokenize_samples, REPETITIONS },
+        { "parse", "ns", BATCH, parse_samples, REPETITIONS },
+        { "script_loop_1000", "ns", LOOP_ITERATIONS, loop_samples, REPETITIONS },
+        { "script_unrolled_1000", "ns", LOOP_ITERATIONS, unrolled_samples, REPETITIONS },
+        { "spawn_true", "us", SPAWN_ITERATIONS, spawn_samples, SPAWN_ITERATIONS },
+        { "pipeline_startup_20", "us", PIPELINE_ITERATIONS, pipeline_samples, PIPELINE_ITERATIONS },
+    };
+    bench_print_json(results, sizeof(results) / sizeof(results[0]));
+    return 0;
+}
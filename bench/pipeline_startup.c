@@ -0,0 +1,31 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "driver.h"
+
+//Measures the time from the Enter key until every stage of an N-stage
+//pipeline has been exec'd (see pipeline_startup() in driver.h).
+//
+//usage: pipeline_startup [shell] [stages] [iterations]
+
+int main(int argc, char* argv[]){
+    const char* shell = (argc > 1) ? argv[1] : "./simsh3";
+    int stages = (argc > 2) ? atoi(argv[2]) : 20;
+    int iterations = (argc > 3) ? atoi(argv[3]) : 50;
+    if(stages < 1 || iterations < 1){
+        printf("usage: %s [shell] [stages] [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    shell_proc_t proc;
+    if(shell_start(shell, &proc) != 0) return 1;
+    double samples[iterations];
+    if(pipeline_startup(&proc, stages, samples, iterations) != 0) return 1;
+    shell_stop(&proc);
+
+    char name[64];
+    snprintf(name, sizeof(name), "pipeline_startup_%d", stages);
+    bench_result_t result = { name, "us", iterations, samples, iterations };
+    bench_print_json(&result, 1);
+    return 0;
+}
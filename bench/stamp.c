@@ -0,0 +1,27 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+//Pipeline stage used by pipeline_startup: appends the CLOCK_MONOTONIC time at
+//which it started running to $SIMSH_BENCH_STAMPS and exits
+int main(int argc, char* argv[]){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    char* path = getenv("SIMSH_BENCH_STAMPS");
+    if(path == NULL) return 1;
+
+    char line[64];
+    int len = snprintf(line, sizeof(line), "%lld\n",
+                       (long long) now.tv_sec * 1000000000LL + now.tv_nsec);
+    //O_APPEND writes of one short line are atomic, so stages don't interleave
+    int fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if(fd == -1) return 1;
+    write(fd, line, len);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,387 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/wait.h>
+
+#include "capture.h"
+#include "childmsg.h"
+
+capture_jobs_t * capture_jobs_create( size_t ring_size )
+{
+    capture_jobs_t * new_jobs = ( capture_jobs_t * )calloc( 1, sizeof( capture_jobs_t ) );
+    new_jobs->ring_size = ring_size;
+    new_jobs->next_id = 1;
+    return new_jobs;
+}
+
+static void free_job( struct capture_job_t * job )
+{
+    if( job->fd != -1 )
+        close( job->fd );
+    if( job->spill_fd != -1 )
+        close( job->spill_fd );
+    free( job->command );
+    free( job->ring );
+    free( job );
+}
+
+//Unlinks job from the table and frees it
+static void remove_job( capture_jobs_t * ijobs, struct capture_job_t * job )
+{
+    struct capture_job_t ** link = &ijobs->head;
+    while( *link != job )
+        link = &( *link )->next;
+    *link = job->next;
+    if( job->fd != -1 )
+        ijobs->open_fds--;
+    free_job( job );
+    //Numbering starts over once nothing is left to refer to
+    if( --ijobs->size == 0 )
+        ijobs->next_id = 1;
+}
+
+void capture_jobs_delete( capture_jobs_t * ijobs )
+{
+    while( ijobs->head != NULL ) {
+        struct capture_job_t * next = ijobs->head->next;
+        free_job( ijobs->head );
+        ijobs->head = next;
+    }
+    free( ijobs->pollfds );
+    free( ijobs );
+}
+
+int capture_jobs_add( capture_jobs_t * ijobs, int fd, const char * command )
+{
+    struct capture_job_t * job = ( struct capture_job_t * )calloc( 1, sizeof( struct capture_job_t ) );
+    struct capture_job_t ** link = &ijobs->head;
+
+    fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+    job->id = ijobs->next_id++;
+    job->fd = fd;
+    job->spill_fd = -1;
+    job->command = strdup( command );
+    //Kept in job order for the listing
+    while( *link != NULL )
+        link = &( *link )->next;
+    *link = job;
+    ijobs->size++;
+    ijobs->open_fds++;
+    return job->id;
+}
+
+static struct capture_job_t * find_job( const capture_jobs_t * ijobs, int id )
+{
+    struct capture_job_t * job;
+    for( job = ijobs->head; job != NULL; job = job->next ) {
+        if( job->id == id )
+            return job;
+    }
+    return NULL;
+}
+
+//Appends len bytes to the job's spill file, opening it on first use
+static void spill( struct capture_job_t * job, const char * data, size_t len )
+{
+    if( job->spill_fd == -1 ) {
+        char path[ 4096 ];
+        const char * tmpdir = getenv( "TMPDIR" );
+        snprintf( path, sizeof( path ), "%s/simsh-job-XXXXXX",
+                  ( tmpdir != NULL && tmpdir[ 0 ] != '\0' ) ? tmpdir : "/tmp" );
+        job->spill_fd = mkostemp( path, O_CLOEXEC );
+        if( job->spill_fd != -1 )
+            unlink( path );
+    }
+    if( job->spill_fd == -1 || pwrite( job->spill_fd, data, len, job->spill_start + job->spilled ) != ( ssize_t )len ) {
+        job->dropped += len;
+        return;
+    }
+    job->spilled += len;
+}
+
+//Moves the oldest len bytes of the ring to the spill file
+static void spill_ring( capture_jobs_t * ijobs, struct capture_job_t * job, size_t len )
+{
+    size_t first = ijobs->ring_size - job->start;
+    if( first > len )
+        first = len;
+    spill( job, job->ring + job->start, first );
+    if( len > first )
+        spill( job, job->ring, len - first );
+    job->start = ( job->start + len ) % ijobs->ring_size;
+    job->size -= len;
+}
+
+static void ring_append( capture_jobs_t * ijobs, struct capture_job_t * job, const char * data, size_t len )
+{
+    size_t cap = ijobs->ring_size;
+
+    if( job->ring == NULL )
+        job->ring = ( char * )malloc( cap );
+    //Only the last cap bytes of a large write can stay in memory
+    if( len >= cap ) {
+        spill_ring( ijobs, job, job->size );
+        spill( job, data, len - cap );
+        data += len - cap;
+        len = cap;
+    }
+    else if( job->size + len > cap ) {
+        spill_ring( ijobs, job, job->size + len - cap );
+    }
+    while( len > 0 ) {
+        size_t end = ( job->start + job->size ) % cap;
+        size_t chunk = ( end >= job->start && job->size < cap ) ? cap - end : job->start - end;
+        if( chunk > len )
+            chunk = len;
+        memcpy( job->ring + end, data, chunk );
+        job->size += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+}
+
+//Reads everything waiting on the job's pipe; at EOF closes it, and drops the
+//job outright if it never wrote anything
+static void drain_job( capture_jobs_t * ijobs, struct capture_job_t * job )
+{
+    char buffer[ 65536 ];
+    ssize_t n;
+
+    while( ( n = read( job->fd, buffer, sizeof( buffer ) ) ) > 0 )
+        ring_append( ijobs, job, buffer, n );
+    if( n == -1 && ( errno == EAGAIN || errno == EINTR ) )
+        return;
+    close( job->fd );
+    job->fd = -1;
+    ijobs->open_fds--;
+    if( job->size == 0 && job->spilled == 0 && job->dropped == 0 )
+        remove_job( ijobs, job );
+}
+
+int capture_jobs_wait( capture_jobs_t * ijobs, int fd, int timeout_ms )
+{
+    while( 1 ) {
+        struct capture_job_t * job;
+        int num_fds = 0;
+        int ready;
+        int i;
+
+        if( fd == -1 && ijobs->open_fds == 0 )
+            return 1;
+        if( ijobs->pollfds_capacity < ijobs->open_fds + 1 ) {
+            ijobs->pollfds_capacity = ijobs->open_fds + 16;
+            ijobs->pollfds = realloc( ijobs->pollfds, ijobs->pollfds_capacity * sizeof( struct pollfd ) );
+        }
+        if( fd != -1 ) {
+            ijobs->pollfds[ num_fds ].fd = fd;
+            ijobs->pollfds[ num_fds++ ].events = POLLIN;
+        }
+        for( job = ijobs->head; job != NULL; job = job->next ) {
+            if( job->fd == -1 )
+                continue;
+            ijobs->pollfds[ num_fds ].fd = job->fd;
+            ijobs->pollfds[ num_fds++ ].events = POLLIN;
+        }
+
+        ready = poll( ijobs->pollfds, num_fds, timeout_ms );
+        if( ready == -1 && errno == EINTR )
+            continue;
+        if( ready <= 0 )
+            return ready;
+
+        //The table is walked in the same order it was gathered in; draining
+        //can remove the job, so step past it first
+        i = ( fd != -1 ) ? 1 : 0;
+        job = ijobs->head;
+        while( job != NULL ) {
+            struct capture_job_t * next = job->next;
+            if( job->fd != -1 ) {
+                if( ijobs->pollfds[ i++ ].revents != 0 )
+                    drain_job( ijobs, job );
+            }
+            job = next;
+        }
+        if( fd != -1 && ijobs->pollfds[ 0 ].revents != 0 )
+            return 1;
+        if( timeout_ms == 0 )
+            return 0;
+    }
+}
+
+//write() all of data to fd
+static void write_out( int fd, const char * data, size_t len )
+{
+    while( len > 0 ) {
+        ssize_t n = write( fd, data, len );
+        if( n <= 0 )
+            return;
+        data += n;
+        len -= n;
+    }
+}
+
+static void print_output( const capture_jobs_t * ijobs, const struct capture_job_t * job, int out_fd )
+{
+    char buffer[ 65536 ];
+    off_t offset = job->spill_start;
+
+    if( job->dropped > 0 ) {
+        buffer[ 0 ] = '\0';
+        childmsg_add( buffer, sizeof( buffer ), "[" );
+        childmsg_add_int( buffer, sizeof( buffer ), job->id );
+        childmsg_add( buffer, sizeof( buffer ), "] " );
+        childmsg_add_int( buffer, sizeof( buffer ), job->dropped );
+        childmsg_add( buffer, sizeof( buffer ), " bytes of output lost\n" );
+        childmsg_write( out_fd, buffer );
+    }
+    while( offset < job->spill_start + job->spilled ) {
+        size_t len = sizeof( buffer );
+        if( ( off_t )len > job->spill_start + job->spilled - offset )
+            len = job->spill_start + job->spilled - offset;
+        ssize_t n = pread( job->spill_fd, buffer, len, offset );
+        if( n <= 0 )
+            break;
+        write_out( out_fd, buffer, n );
+        offset += n;
+    }
+    if( job->size > 0 ) {
+        size_t first = ijobs->ring_size - job->start;
+        if( first > job->size )
+            first = job->size;
+        write_out( out_fd, job->ring + job->start, first );
+        write_out( out_fd, job->ring, job->size - first );
+    }
+}
+
+//Forgets the first len bytes of the job's output and dropped bytes lost
+//before them; shown once, so the next -o picks up where the last stopped
+static void discard_output( capture_jobs_t * ijobs, struct capture_job_t * job, off_t len, off_t dropped )
+{
+    off_t chunk = ( len < job->spilled ) ? len : job->spilled;
+
+    job->spill_start += chunk;
+    job->spilled -= chunk;
+    len -= chunk;
+    if( job->spilled == 0 && job->spill_fd != -1 ) {
+        close( job->spill_fd );
+        job->spill_fd = -1;
+        job->spill_start = 0;
+    }
+    chunk = ( len < ( off_t )job->size ) ? len : ( off_t )job->size;
+    job->start = ( job->start + chunk ) % ijobs->ring_size;
+    job->size -= chunk;
+    if( job->size == 0 ) {
+        free( job->ring );
+        job->ring = NULL;
+        job->start = 0;
+    }
+    job->dropped -= ( dropped < job->dropped ) ? dropped : job->dropped;
+    job->shown_by = 0;
+}
+
+//The job "jobs -o %n" asks for, NULL if argv is anything else
+static struct capture_job_t * output_job( const capture_jobs_t * ijobs, char ** argv )
+{
+    if( argv[ 1 ] == NULL || strcmp( argv[ 1 ], "-o" ) != 0 || argv[ 2 ] == NULL
+        || argv[ 2 ][ 0 ] != '%' || argv[ 3 ] != NULL )
+        return NULL;
+    return find_job( ijobs, atoi( argv[ 2 ] + 1 ) );
+}
+
+int capture_jobs_print( const capture_jobs_t * ijobs, char ** argv, int out_fd )
+{
+    struct capture_job_t * job;
+    char line[ 512 ];
+    char number[ 24 ];
+
+    if( ijobs == NULL ) {
+        childmsg_write( out_fd, "jobs: background output is not being captured\n" );
+        return 1;
+    }
+    if( argv[ 1 ] == NULL ) {
+        for( job = ijobs->head; job != NULL; job = job->next ) {
+            line[ 0 ] = '\0';
+            childmsg_add( line, sizeof( line ), "[" );
+            childmsg_add_int( line, sizeof( line ), job->id );
+            childmsg_add( line, sizeof( line ), "] " );
+            childmsg_add_padded( line, sizeof( line ), ( job->fd != -1 ) ? "Running" : "Done", 8, 1 );
+            childmsg_add( line, sizeof( line ), " " );
+            number[ 0 ] = '\0';
+            childmsg_add_int( number, sizeof( number ), job->spilled + job->size );
+            childmsg_add_padded( line, sizeof( line ), number, 10, 0 );
+            childmsg_add( line, sizeof( line ), " bytes  " );
+            childmsg_add( line, sizeof( line ), job->command );
+            childmsg_add( line, sizeof( line ), "\n" );
+            childmsg_write( out_fd, line );
+        }
+        return 0;
+    }
+    if( strcmp( argv[ 1 ], "-o" ) != 0 || argv[ 2 ] == NULL || argv[ 2 ][ 0 ] != '%' || argv[ 3 ] != NULL ) {
+        childmsg_write( out_fd, "jobs: usage: jobs [-o %n]\n" );
+        return 2;
+    }
+    job = output_job( ijobs, argv );
+    if( job == NULL ) {
+        line[ 0 ] = '\0';
+        childmsg_add( line, sizeof( line ), "jobs: " );
+        childmsg_add( line, sizeof( line ), argv[ 2 ] );
+        childmsg_add( line, sizeof( line ), ": no such job\n" );
+        childmsg_write( out_fd, line );
+        return 1;
+    }
+    print_output( ijobs, job, out_fd );
+    return 0;
+}
+
+void capture_jobs_shown_by( capture_jobs_t * ijobs, char ** argv, int pid )
+{
+    struct capture_job_t * job = output_job( ijobs, argv );
+
+    if( job == NULL )
+        return;
+    job->shown_by = pid;
+    job->shown_len = job->spilled + job->size;
+    job->shown_dropped = job->dropped;
+}
+
+void capture_jobs_stage_exited( capture_jobs_t * ijobs, int pid, int status )
+{
+    struct capture_job_t * job;
+
+    for( job = ijobs->head; job != NULL; job = job->next ) {
+        if( job->shown_by != pid )
+            continue;
+        job->shown_by = 0;
+        //A stage whose redirection failed printed nothing
+        if( !WIFEXITED( status ) || WEXITSTATUS( status ) != 0 )
+            return;
+        discard_output( ijobs, job, job->shown_len, job->shown_dropped );
+        if( job->fd == -1 && job->size == 0 && job->spilled == 0 && job->dropped == 0 )
+            remove_job( ijobs, job );
+        return;
+    }
+}
+
+int capture_jobs_builtin( capture_jobs_t * ijobs, char ** argv, int out_fd )
+{
+    struct capture_job_t * job;
+    int status;
+
+    if( ijobs == NULL )
+        return capture_jobs_print( NULL, argv, out_fd );
+    //Pick up whatever the jobs wrote since the last prompt
+    capture_jobs_wait( ijobs, -1, 0 );
+    status = capture_jobs_print( ijobs, argv, out_fd );
+    job = output_job( ijobs, argv );
+    if( job != NULL ) {
+        discard_output( ijobs, job, job->spilled + job->size, job->dropped );
+        if( job->fd == -1 )
+            remove_job( ijobs, job );
+    }
+    return status;
+}
@@ -0,0 +1,88 @@
+#if !defined( __capture_h )
+#define __capture_h 1
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <poll.h>
+
+/* Output capture for background jobs. Each job's stdout and stderr go to one
+ * pipe that the shell drains into a ring buffer of ring_size bytes; bytes
+ * pushed out of a full ring are appended to an unlinked spill file, so memory
+ * stays bounded however much the job writes and nothing is lost. The ring is
+ * only allocated once the job writes something.
+ */
+struct capture_job_t {
+    int id;           //%n
+    int fd;           //non-blocking read end of the job's pipe; -1 after EOF
+    char * command;   //for the jobs listing
+    char * ring;
+    size_t start;     //oldest byte in ring
+    size_t size;      //bytes in ring
+    int spill_fd;     //-1 until the ring first overflows
+    off_t spill_start; //offset of the first byte not yet shown
+    off_t spilled;    //bytes waiting in the spill file, from spill_start
+    off_t dropped;    //bytes lost because no spill file could be made
+    int shown_by;     //pid of a forked jobs -o stage printing this job, or 0
+    off_t shown_len;  //output there was for it to print
+    off_t shown_dropped; //and lost bytes it reported
+    struct capture_job_t * next;
+};
+
+typedef struct {
+    size_t ring_size;
+    int size;
+    int open_fds;     //jobs whose pipe is still open
+    int next_id;
+    struct capture_job_t * head;
+    struct pollfd * pollfds;  //scratch space for capture_jobs_wait()
+    int pollfds_capacity;
+} capture_jobs_t;
+
+capture_jobs_t * capture_jobs_create( size_t ring_size );
+
+/* capture_jobs_delete(): closes every pipe and spill file; unread output is lost */
+void capture_jobs_delete( capture_jobs_t * ijobs );
+
+/* capture_jobs_add(): starts tracking a background job
+ * input: fd is the read end of the job's pipe, with the write end already
+ *   closed in the shell; command is copied for the listing
+ * return value: the job's number
+ */
+int capture_jobs_add( capture_jobs_t * ijobs, int fd, const char * command );
+
+/* capture_jobs_wait(): drains job output until fd is readable
+ * input: fd to wait for, or -1 to drain until every pipe is closed;
+ *   timeout_ms as for poll(), 0 to drain what is already waiting
+ * return value: 1 once fd is readable (or the pipes are all closed), 0 on
+ *   timeout, -1 on error
+ */
+int capture_jobs_wait( capture_jobs_t * ijobs, int fd, int timeout_ms );
+
+/* capture_jobs_builtin(): the jobs builtin
+ * "jobs" lists the captured jobs; "jobs -o %n" prints job n's output so far
+ * and discards it, dropping the job once it has finished. Everything,
+ * errors included, is written to out_fd. ijobs is NULL when capture is off.
+ * return value: exit status for the builtin
+ */
+int capture_jobs_builtin( capture_jobs_t * ijobs, char ** argv, int out_fd );
+
+/* capture_jobs_print(): the printing half of the jobs builtin, for a jobs
+ * stage that is piped or redirected and so runs in a forked child. It only
+ * reads the table and formats with childmsg.h and write(), and does not
+ * drain the pipes: the shell does that before forking.
+ * return value: exit status for the builtin
+ */
+int capture_jobs_print( const capture_jobs_t * ijobs, char ** argv, int out_fd );
+
+/* capture_jobs_shown_by(): after forking such a stage, notes how much of
+ * the job named by argv (if any) it was given to print
+ */
+void capture_jobs_shown_by( capture_jobs_t * ijobs, char ** argv, int pid );
+
+/* capture_jobs_stage_exited(): called with the wait status of every reaped
+ * process; if pid was a jobs -o stage and exited with status 0, the output
+ * it printed is discarded. Output that arrived since it was forked is kept.
+ */
+void capture_jobs_stage_exited( capture_jobs_t * ijobs, int pid, int status );
+
+#endif /* __capture_h */
@@ -0,0 +1,233 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "cgroup.h"
+#include "childmsg.h"
+
+#define CGROUP_DEFAULT_ROOT "/sys/fs/cgroup/simsh"
+
+static const char * cgroup_root( void )
+{
+    const char * root = getenv( "SIMSH_CGROUP_ROOT" );
+    return ( root != NULL && root[ 0 ] != '\0' ) ? root : CGROUP_DEFAULT_ROOT;
+}
+
+//Writes a short string to a cgroup control file; returns 0 on success
+static int write_control( const char * dir, const char * file, const char * value )
+{
+    char path[ 4096 ];
+    int fd;
+    ssize_t len = strlen( value );
+
+    snprintf( path, sizeof( path ), "%s/%s", dir, file );
+    fd = open( path, O_WRONLY | O_CLOEXEC );
+    if( fd == -1 )
+        return -1;
+    if( write( fd, value, len ) != len ) {
+        close( fd );
+        return -1;
+    }
+    return close( fd );
+}
+
+//Reads "key value" out of a flat-keyed file such as cpu.stat; -1 if absent
+static long long read_keyed( const char * dir, const char * file, const char * key )
+{
+    char path[ 4096 ];
+    char name[ 64 ];
+    long long value;
+    FILE * f;
+
+    snprintf( path, sizeof( path ), "%s/%s", dir, file );
+    f = fopen( path, "re" );
+    if( f == NULL )
+        return -1;
+    while( fscanf( f, "%63s %lld", name, &value ) == 2 ) {
+        if( strcmp( name, key ) == 0 ) {
+            fclose( f );
+            return value;
+        }
+    }
+    fclose( f );
+    return -1;
+}
+
+//Reads a single-value file such as memory.peak; -1 if absent
+static long long read_single( const char * dir, const char * file )
+{
+    char path[ 4096 ];
+    long long value = -1;
+    FILE * f;
+
+    snprintf( path, sizeof( path ), "%s/%s", dir, file );
+    f = fopen( path, "re" );
+    if( f == NULL )
+        return -1;
+    if( fscanf( f, "%lld", &value ) != 1 )
+        value = -1;
+    fclose( f );
+    return value;
+}
+
+cgroup_jobs_t * cgroup_jobs_create( void )
+{
+    cgroup_jobs_t * new_jobs = ( cgroup_jobs_t * )malloc(sizeof(cgroup_jobs_t));
+    new_jobs->head = NULL;
+    new_jobs->size = 0;
+    return new_jobs;
+}
+
+void cgroup_jobs_delete( cgroup_jobs_t * ijobs )
+{
+    struct cgroup_job_t * cur_job, * tmp_job;
+
+    cur_job = ijobs->head;
+    while( cur_job != NULL ) {
+        tmp_job = cur_job;
+        cur_job = cur_job->next;
+        free( tmp_job->path );
+        free( tmp_job );
+    }
+    free( ijobs );
+}
+
+char * cgroup_create( const job_limits_t * ilimits, char * warning, size_t warning_size )
+{
+    const char * root = cgroup_root();
+    char value[ 64 ];
+    char * path;
+
+    //The root only holds job cgroups, so it may hand cpu and memory down
+    if( mkdir( root, 0755 ) == -1 && errno != EEXIST ) {
+        snprintf( warning, warning_size, "run: %s: %s, running without a cgroup", root, strerror( errno ) );
+        return NULL;
+    }
+    if( write_control( root, "cgroup.subtree_control", "+cpu +memory" ) == -1 ) {
+        snprintf( warning, warning_size, "run: %s: cannot enable cpu/memory controllers, running without a cgroup", root );
+        return NULL;
+    }
+
+    path = ( char * ) malloc( strlen( root ) + 32 );
+    sprintf( path, "%s/job-%d-XXXXXX", root, (int) getpid() );
+    if( mkdtemp( path ) == NULL ) {
+        snprintf( warning, warning_size, "run: %s: %s, running without a cgroup", root, strerror( errno ) );
+        free( path );
+        return NULL;
+    }
+
+    if( ilimits->cpu_quota_us != -1 ) {
+        snprintf( value, sizeof( value ), "%ld 100000", ilimits->cpu_quota_us );
+        if( write_control( path, "cpu.max", value ) == -1 )
+            snprintf( warning, warning_size, "run: cannot set cpu.max: %s", strerror( errno ) );
+    }
+    if( ilimits->mem_bytes != -1 ) {
+        snprintf( value, sizeof( value ), "%lld", ilimits->mem_bytes );
+        if( write_control( path, "memory.max", value ) == -1 )
+            snprintf( warning, warning_size, "run: cannot set memory.max: %s", strerror( errno ) );
+    }
+    return path;
+}
+
+int cgroup_enter( const char * path, char * error, size_t error_size )
+{
+    char procs[ 4096 ];
+    int fd;
+    int err;
+
+    //Runs after fork(), so no snprintf()/strerror() here (see childmsg.h)
+    procs[ 0 ] = '\0';
+    childmsg_add( procs, sizeof( procs ), path );
+    childmsg_add( procs, sizeof( procs ), "/cgroup.procs" );
+    fd = open( procs, O_WRONLY | O_CLOEXEC );
+    //Writing "0" moves the writer itself
+    if( fd != -1 && write( fd, "0", 1 ) == 1 && close( fd ) == 0 )
+        return 0;
+    err = errno;
+    if( fd != -1 )
+        close( fd );
+    error[ 0 ] = '\0';
+    childmsg_add( error, error_size, "run: cannot join " );
+    childmsg_add( error, error_size, path );
+    childmsg_add( error, error_size, ": " );
+    childmsg_add_errno( error, error_size, err );
+    return -1;
+}
+
+int cgroup_place( const char * path, int pid )
+{
+    char value[ 32 ];
+
+    snprintf( value, sizeof( value ), "%d", pid );
+    //ESRCH: the process already ran and exited inside the cgroup
+    if( write_control( path, "cgroup.procs", value ) == -1 && errno != ESRCH )
+        return -1;
+    return 0;
+}
+
+int cgroup_finish( char * path, int pid, simsh_job_stats_t * stats )
+{
+    long long usage_usec = read_keyed( path, "cpu.stat", "usage_usec" );
+    long long peak = read_single( path, "memory.peak" );
+
+    //memory.peak is only there on newer kernels; the fallback has to be
+    //read while the directory still exists
+    if( peak == -1 )
+        peak = read_single( path, "memory.current" );
+
+    //Something still lives in it (a daemonized grandchild, say); keep the
+    //directory so it can be tried again rather than leaked
+    if( rmdir( path ) == -1 && errno == EBUSY )
+        return -1;
+
+    stats->pid = pid;
+    snprintf( stats->name, sizeof( stats->name ), "%s", strrchr( path, '/' ) + 1 );
+    stats->cpu_usec = usage_usec;
+    stats->memory_peak = peak;
+    free( path );
+    return 0;
+}
+
+void cgroup_jobs_add( cgroup_jobs_t * ijobs, char * path, int pid )
+{
+    struct cgroup_job_t * new_job = ( struct cgroup_job_t * )
+        malloc(sizeof(struct cgroup_job_t));
+    new_job->path = path;
+    new_job->pid = pid;
+    new_job->next = ijobs->head;
+    ijobs->head = new_job;
+    ijobs->size++;
+}
+
+void cgroup_jobs_reap( cgroup_jobs_t * ijobs, simsh_stats_fn report, void * arg )
+{
+    struct cgroup_job_t * prev_job, * cur_job;
+    simsh_job_stats_t stats;
+
+    prev_job = NULL;
+    cur_job = ijobs->head;
+    while( cur_job != NULL ) {
+        //populated drops to 0 once the last process in the cgroup exits
+        if( read_keyed( cur_job->path, "cgroup.events", "populated" ) != 1
+            && cgroup_finish( cur_job->path, cur_job->pid, &stats ) == 0 ) {
+            struct cgroup_job_t * done_job = cur_job;
+            if( prev_job == NULL )
+                ijobs->head = cur_job->next;
+            else
+                prev_job->next = cur_job->next;
+            cur_job = cur_job->next;
+            ijobs->size--;
+            free( done_job );
+            if( report != NULL )
+                report( arg, &stats );
+            continue;
+        }
+        prev_job = cur_job;
+        cur_job = cur_job->next;
+    }
+}
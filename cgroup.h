@@ -0,0 +1,63 @@
+#if !defined( __cgroup_h )
+#define __cgroup_h 1
+
+#include "joblimits.h"
+#include "simsh.h"
+
+/* Jobs placed in their own cgroup v2 directory by "run --cpu=N --mem=SIZE".
+ * The directories live under $SIMSH_CGROUP_ROOT (default /sys/fs/cgroup/simsh),
+ * which must be delegated to the user running the shell.
+ */
+struct cgroup_job_t {
+    char * path;
+    int pid;  //last stage of the job, for its stats
+    struct cgroup_job_t * next;
+};
+
+typedef struct {
+    int size;
+    struct cgroup_job_t * head;
+} cgroup_jobs_t;
+
+cgroup_jobs_t * cgroup_jobs_create( void );
+void cgroup_jobs_delete( cgroup_jobs_t * ijobs );
+
+/* cgroup_create(): makes a new cgroup with the job's cpu.max and memory.max
+ * input: warning receives the reason the job will run without a cgroup, or
+ *   without one of its limits
+ * return value: malloc'd path of the cgroup, or NULL
+ */
+char * cgroup_create( const job_limits_t * ilimits, char * warning, size_t warning_size );
+
+/* cgroup_enter(): moves the calling process into the cgroup at path
+ * Meant for the child between fork() and exec().
+ * return value: 0 on success, -1 with a message in error
+ */
+int cgroup_enter( const char * path, char * error, size_t error_size );
+
+/* cgroup_place(): moves process pid into the cgroup at path
+ * The launcher calls it for every child it forks, so the job is in its
+ * cgroup before the launcher returns even if a child has not reached its
+ * own cgroup_enter() yet; cgroup_jobs_reap() can then trust populated.
+ * return value: 0 on success (or if pid is already gone), -1 otherwise
+ */
+int cgroup_place( const char * path, int pid );
+
+/* cgroup_finish(): reads the cgroup's CPU and peak memory usage into stats,
+ * removes the directory and frees path. Call once every process in it has
+ * exited.
+ * return value: 0 when done, -1 (path untouched) if the cgroup is still busy
+ */
+int cgroup_finish( char * path, int pid, simsh_job_stats_t * stats );
+
+/* cgroup_jobs_add(): tracks a job's cgroup until it empties
+ * input: pid of the job's last stage, passed on in its stats
+ */
+void cgroup_jobs_add( cgroup_jobs_t * ijobs, char * path, int pid );
+
+/* cgroup_jobs_reap(): finishes every tracked cgroup with no live processes,
+ * handing each one's stats to report (if not NULL)
+ */
+void cgroup_jobs_reap( cgroup_jobs_t * ijobs, simsh_stats_fn report, void * arg );
+
+#endif /* __cgroup_h */
@@ -0,0 +1,68 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include <unistd.h>
+
+#include "childmsg.h"
+
+void childmsg_add( char * buf, size_t size, const char * s )
+{
+    size_t len = strlen( buf );
+
+    while( *s != '\0' && len + 1 < size )
+        buf[ len++ ] = *s++;
+    buf[ len ] = '\0';
+}
+
+void childmsg_add_int( char * buf, size_t size, long n )
+{
+    char digits[ 24 ];
+    int i = sizeof( digits ) - 1;
+    unsigned long u = ( n < 0 ) ? -( unsigned long )n : ( unsigned long )n;
+
+    digits[ i ] = '\0';
+    do {
+        digits[ --i ] = '0' + u % 10;
+        u /= 10;
+    } while( u > 0 );
+    if( n < 0 )
+        digits[ --i ] = '-';
+    childmsg_add( buf, size, digits + i );
+}
+
+void childmsg_add_padded( char * buf, size_t size, const char * s, int width, int left_align )
+{
+    int pad = width - ( int )strlen( s );
+
+    if( left_align )
+        childmsg_add( buf, size, s );
+    while( pad-- > 0 )
+        childmsg_add( buf, size, " " );
+    if( !left_align )
+        childmsg_add( buf, size, s );
+}
+
+void childmsg_add_errno( char * buf, size_t size, int err )
+{
+    //A lookup in glibc's static table; unlike strerror() it takes no locks
+    const char * text = strerrordesc_np( err );
+
+    if( text != NULL ) {
+        childmsg_add( buf, size, text );
+        return;
+    }
+    childmsg_add( buf, size, "error " );
+    childmsg_add_int( buf, size, err );
+}
+
+void childmsg_write( int fd, const char * buf )
+{
+    size_t len = strlen( buf );
+
+    while( len > 0 ) {
+        ssize_t n = write( fd, buf, len );
+        if( n <= 0 )
+            return;
+        buf += n;
+        len -= n;
+    }
+}
@@ -0,0 +1,28 @@
+#if !defined( __childmsg_h )
+#define __childmsg_h 1
+
+#include <stddef.h>
+
+/* Message building for the child between fork() and exec(). If the host is
+ * multithreaded another thread may have held a stdio, locale or gettext lock
+ * at fork() time, so snprintf() and strerror() could deadlock there; these
+ * only copy bytes. Each call appends to the NUL-terminated string in buf and
+ * truncates quietly at size.
+ */
+void childmsg_add( char * buf, size_t size, const char * s );
+void childmsg_add_int( char * buf, size_t size, long n );
+
+/* childmsg_add_padded(): appends s padded with spaces to width, on the
+ * right when left_align is set ("%-8s") and on the left otherwise ("%8s")
+ */
+void childmsg_add_padded( char * buf, size_t size, const char * s, int width, int left_align );
+
+/* childmsg_add_errno(): appends the untranslated text for err
+ * ("No such file or directory"), or "error N" for an unknown value
+ */
+void childmsg_add_errno( char * buf, size_t size, int err );
+
+/* childmsg_write(): write()s all of the NUL-terminated message to fd */
+void childmsg_write( int fd, const char * buf );
+
+#endif /* __childmsg_h */
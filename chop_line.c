@@ -10,16 +10,19 @@ chopped_line_t * get_chopped_line( const char * iline )
     char * line_copy;
     const char * delim = " \t\n";
     char * cur_token;
+    char * save_ptr;
 
     cl = (chopped_line_t *) malloc ( sizeof(chopped_line_t) );
     cl->tokens = NULL;
     cl->num_tokens = 0;
+    cl->line_copy = NULL;
 
     if( iline == NULL )
         return cl;
 
     line_copy = strdup( iline );
-    cur_token = strtok( line_copy, delim );
+    cl->line_copy = line_copy;
+    cur_token = strtok_r( line_copy, delim, &save_ptr );
     if( cur_token == NULL )
         return cl;
 
@@ -28,7 +31,7 @@ chopped_line_t * get_chopped_line( const char * iline )
         cl->tokens = ( char ** ) realloc( cl->tokens,
                                           cl->num_tokens * sizeof( char * ) );
         cl->tokens[ cl->num_tokens - 1 ] = cur_token;
-    } while( (cur_token = strtok( NULL, delim )) );
+    } while( (cur_token = strtok_r( NULL, delim, &save_ptr )) );
 
     return cl;
 } 
@@ -41,5 +44,6 @@ void free_chopped_line( chopped_line_t * icl )
         return;
 
     free( icl->tokens );
+    free( icl->line_copy );
     free(icl);
 }
@@ -0,0 +1,296 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/resource.h>
+
+#include "joblimits.h"
+#include "childmsg.h"
+
+//Resources the ulimit builtin knows about; unit scales the user-facing value
+struct ulimit_resource_t {
+    char flag;
+    int resource;
+    rlim_t unit;
+    const char * name;
+};
+
+static const struct ulimit_resource_t ulimit_resources[] = {
+    { 'c', RLIMIT_CORE,   1024, "core file size (kbytes)" },
+    { 'd', RLIMIT_DATA,   1024, "data seg size (kbytes)" },
+    { 'f', RLIMIT_FSIZE,  1024, "file size (kbytes)" },
+    { 'n', RLIMIT_NOFILE, 1,    "open files" },
+    { 's', RLIMIT_STACK,  1024, "stack size (kbytes)" },
+    { 't', RLIMIT_CPU,    1,    "cpu time (seconds)" },
+    { 'u', RLIMIT_NPROC,  1,    "max user processes" },
+    { 'v', RLIMIT_AS,     1024, "virtual memory (kbytes)" },
+};
+
+#define NUM_ULIMIT_RESOURCES ( sizeof( ulimit_resources ) / sizeof( ulimit_resources[ 0 ] ) )
+
+void limits_init( job_limits_t * ilimits )
+{
+    ilimits->cpu_quota_us = -1;
+    ilimits->mem_bytes = -1;
+    ilimits->nofile = (rlim_t) -1;
+    ilimits->cpu_seconds = (rlim_t) -1;
+}
+
+int limits_use_cgroup( const job_limits_t * ilimits )
+{
+    return ilimits->cpu_quota_us != -1 || ilimits->mem_bytes != -1;
+}
+
+int limits_any_set( const job_limits_t * ilimits )
+{
+    return limits_use_cgroup( ilimits ) || ilimits->nofile != (rlim_t) -1
+        || ilimits->cpu_seconds != (rlim_t) -1;
+}
+
+//Parses sizes such as 512K, 1G or 100000 (bytes)
+static int parse_size( const char * value, long long * out )
+{
+    char * end;
+    long long size;
+    int shift = 0;
+
+    errno = 0;
+    size = strtoll( value, &end, 10 );
+    if( end == value || size < 0 || errno == ERANGE )
+        return -1;
+    switch( *end ) {
+    case 'k': case 'K': shift = 10; end++; break;
+    case 'm': case 'M': shift = 20; end++; break;
+    case 'g': case 'G': shift = 30; end++; break;
+    case 't': case 'T': shift = 40; end++; break;
+    }
+    if( *end != '\0' || size > ( LLONG_MAX >> shift ) )
+        return -1;
+    size <<= shift;
+    *out = size;
+    return 0;
+}
+
+static int parse_count( const char * value, rlim_t * out )
+{
+    char * end;
+    unsigned long long count;
+
+    if( strcmp( value, "unlimited" ) == 0 ) {
+        *out = RLIM_INFINITY;
+        return 0;
+    }
+    count = strtoull( value, &end, 10 );
+    if( end == value || *end != '\0' || value[ 0 ] == '-' )
+        return -1;
+    *out = (rlim_t) count;
+    return 0;
+}
+
+int limits_parse_option( const char * opt, job_limits_t * ilimits,
+                         char * error, size_t error_size )
+{
+    const char * value = strchr( opt, '=' );
+    size_t name_len;
+
+    if( strncmp( opt, "--", 2 ) != 0 || value == NULL ) {
+        snprintf( error, error_size, "run: bad option %s", opt );
+        return -1;
+    }
+    name_len = value - opt;
+    value++;
+
+    if( name_len == 5 && strncmp( opt, "--cpu", name_len ) == 0 ) {
+        //Number of CPUs, possibly fractional: --cpu=0.5 is half a core
+        char * end;
+        double cpus = strtod( value, &end );
+        //Written this way round so that nan fails too
+        if( end == value || *end != '\0' || !( cpus > 0 && cpus <= LONG_MAX / 100000 ) ) {
+            snprintf( error, error_size, "run: bad cpu count %s", value );
+            return -1;
+        }
+        ilimits->cpu_quota_us = (long) ( cpus * 100000 );
+        if( ilimits->cpu_quota_us < 1000 )
+            ilimits->cpu_quota_us = 1000;
+        return 0;
+    }
+    if( name_len == 5 && strncmp( opt, "--mem", name_len ) == 0 ) {
+        if( parse_size( value, &ilimits->mem_bytes ) == -1 ) {
+            snprintf( error, error_size, "run: bad memory size %s", value );
+            return -1;
+        }
+        return 0;
+    }
+    if( name_len == 8 && strncmp( opt, "--nofile", name_len ) == 0 ) {
+        if( parse_count( value, &ilimits->nofile ) == -1 ) {
+            snprintf( error, error_size, "run: bad file count %s", value );
+            return -1;
+        }
+        return 0;
+    }
+    if( name_len == 6 && strncmp( opt, "--time", name_len ) == 0 ) {
+        if( parse_count( value, &ilimits->cpu_seconds ) == -1 ) {
+            snprintf( error, error_size, "run: bad cpu time %s", value );
+            return -1;
+        }
+        return 0;
+    }
+    snprintf( error, error_size, "run: bad option %s", opt );
+    return -1;
+}
+
+static int set_soft_limit( int resource, rlim_t value )
+{
+    struct rlimit rl;
+
+    if( getrlimit( resource, &rl ) == -1 )
+        return -1;
+    rl.rlim_cur = value;
+    if( rl.rlim_max != RLIM_INFINITY && value > rl.rlim_max )
+        rl.rlim_cur = rl.rlim_max;
+    return setrlimit( resource, &rl );
+}
+
+int limits_apply_rlimits( const job_limits_t * ilimits, char * error, size_t error_size )
+{
+    if( ilimits->nofile != (rlim_t) -1 &&
+        set_soft_limit( RLIMIT_NOFILE, ilimits->nofile ) == -1 ) {
+        int err = errno;
+        error[ 0 ] = '\0';
+        childmsg_add( error, error_size, "run: nofile: " );
+        childmsg_add_errno( error, error_size, err );
+        return -1;
+    }
+    if( ilimits->cpu_seconds != (rlim_t) -1 &&
+        set_soft_limit( RLIMIT_CPU, ilimits->cpu_seconds ) == -1 ) {
+        int err = errno;
+        error[ 0 ] = '\0';
+        childmsg_add( error, error_size, "run: time: " );
+        childmsg_add_errno( error, error_size, err );
+        return -1;
+    }
+    return 0;
+}
+
+static void add_limit( char * line, size_t size, rlim_t value, rlim_t unit )
+{
+    if( value == RLIM_INFINITY )
+        childmsg_add( line, size, "unlimited\n" );
+    else {
+        childmsg_add_int( line, size, (long) ( value / unit ) );
+        childmsg_add( line, size, "\n" );
+    }
+}
+
+int limits_ulimit( char ** argv, int out_fd, int can_set )
+{
+    char line[ 128 ];
+    char flag[ 4 ] = { '-', '\0', ')', '\0' };
+    const struct ulimit_resource_t * res = &ulimit_resources[ 3 ]; //-n by default
+    int set_soft = 1;
+    int set_hard = 1;
+    int show_all = 0;
+    int explicit_kind = 0;
+    const char * value = NULL;
+    struct rlimit rl;
+    unsigned int i;
+    int argi;
+
+    for( argi = 1; argv[ argi ] != NULL; argi++ ) {
+        const char * arg = argv[ argi ];
+        const char * c;
+        if( arg[ 0 ] != '-' || arg[ 1 ] == '\0' ) {
+            value = arg;
+            continue;
+        }
+        for( c = arg + 1; *c != '\0'; c++ ) {
+            if( *c == 'a' ) {
+                show_all = 1;
+            }
+            else if( *c == 'S' || *c == 'H' ) {
+                //The first -S/-H picks the kind; naming both sets both
+                if( !explicit_kind ) {
+                    set_soft = 0;
+                    set_hard = 0;
+                    explicit_kind = 1;
+                }
+                if( *c == 'S' ) set_soft = 1;
+                else set_hard = 1;
+            }
+            else {
+                for( i = 0; i < NUM_ULIMIT_RESOURCES; i++ ) {
+                    if( ulimit_resources[ i ].flag == *c ) break;
+                }
+                if( i == NUM_ULIMIT_RESOURCES ) {
+                    flag[ 1 ] = *c;
+                    flag[ 2 ] = '\0';
+                    line[ 0 ] = '\0';
+                    childmsg_add( line, sizeof( line ), "ulimit: " );
+                    childmsg_add( line, sizeof( line ), flag );
+                    childmsg_add( line, sizeof( line ), ": invalid option\n" );
+                    childmsg_write( out_fd, line );
+                    return 1;
+                }
+                res = &ulimit_resources[ i ];
+            }
+        }
+    }
+
+    if( show_all ) {
+        for( i = 0; i < NUM_ULIMIT_RESOURCES; i++ ) {
+            getrlimit( ulimit_resources[ i ].resource, &rl );
+            flag[ 1 ] = ulimit_resources[ i ].flag;
+            line[ 0 ] = '\0';
+            childmsg_add_padded( line, sizeof( line ), ulimit_resources[ i ].name, 26, 1 );
+            childmsg_add( line, sizeof( line ), " (" );
+            childmsg_add( line, sizeof( line ), flag );
+            childmsg_add( line, sizeof( line ), " " );
+            add_limit( line, sizeof( line ), set_soft ? rl.rlim_cur : rl.rlim_max,
+                       ulimit_resources[ i ].unit );
+            childmsg_write( out_fd, line );
+        }
+        return 0;
+    }
+
+    line[ 0 ] = '\0';
+    if( getrlimit( res->resource, &rl ) == -1 ) {
+        childmsg_add( line, sizeof( line ), "ulimit: " );
+        childmsg_add_errno( line, sizeof( line ), errno );
+        childmsg_add( line, sizeof( line ), "\n" );
+        childmsg_write( out_fd, line );
+        return 1;
+    }
+    if( value == NULL ) {
+        //Show the soft limit unless only -H was given
+        add_limit( line, sizeof( line ), set_soft ? rl.rlim_cur : rl.rlim_max, res->unit );
+        childmsg_write( out_fd, line );
+        return 0;
+    }
+
+    rlim_t new_value;
+    if( parse_count( value, &new_value ) == -1 ) {
+        childmsg_add( line, sizeof( line ), "ulimit: " );
+        childmsg_add( line, sizeof( line ), value );
+        childmsg_add( line, sizeof( line ), ": invalid number\n" );
+        childmsg_write( out_fd, line );
+        return 1;
+    }
+    //A forked stage's limits die with it
+    if( !can_set )
+        return 0;
+    if( new_value != RLIM_INFINITY )
+        new_value *= res->unit;
+    if( set_soft ) rl.rlim_cur = new_value;
+    if( set_hard ) rl.rlim_max = new_value;
+    if( setrlimit( res->resource, &rl ) == -1 ) {
+        childmsg_add( line, sizeof( line ), "ulimit: " );
+        childmsg_add( line, sizeof( line ), res->name );
+        childmsg_add( line, sizeof( line ), ": " );
+        childmsg_add_errno( line, sizeof( line ), errno );
+        childmsg_add( line, sizeof( line ), "\n" );
+        childmsg_write( out_fd, line );
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,46 @@
+#if !defined( __joblimits_h )
+#define __joblimits_h 1
+
+#include <stddef.h>
+#include <sys/resource.h>
+
+/* Per-job limits requested with "run --opt=value ... cmd". A value of -1
+ * means the option was not given and the job inherits the shell's setting.
+ */
+typedef struct {
+    long cpu_quota_us;        //--cpu=N: cgroup cpu.max quota per 100ms period
+    long long mem_bytes;      //--mem=SIZE: cgroup memory.max
+    rlim_t nofile;            //--nofile=N: RLIMIT_NOFILE
+    rlim_t cpu_seconds;       //--time=SECS: RLIMIT_CPU
+} job_limits_t;
+
+/* limits_init(): marks every limit as not set */
+void limits_init( job_limits_t * ilimits );
+
+/* limits_use_cgroup(): reports whether the job needs its own cgroup */
+int limits_use_cgroup( const job_limits_t * ilimits );
+
+/* limits_any_set(): reports whether run set any limit at all */
+int limits_any_set( const job_limits_t * ilimits );
+
+/* limits_parse_option(): parses one "--name=value" option of the run builtin
+ * return value: 0 on success, -1 with a message in error
+ */
+int limits_parse_option( const char * opt, job_limits_t * ilimits,
+                         char * error, size_t error_size );
+
+/* limits_apply_rlimits(): applies the job's rlimits to the calling process
+ * Meant for the child between fork() and exec().
+ * return value: 0 on success, -1 with a message in error
+ */
+int limits_apply_rlimits( const job_limits_t * ilimits, char * error, size_t error_size );
+
+/* limits_ulimit(): the ulimit builtin, e.g. "ulimit -a" or "ulimit -n 1024"
+ * input: NULL-terminated argv, argv[0] == "ulimit"; output and errors are
+ *   written to out_fd with childmsg.h, so a forked pipeline stage may call
+ *   it; can_set is 0 there, and a new value is checked but not applied
+ * return value: 0 on success, 1 after printing an error
+ */
+int limits_ulimit( char ** argv, int out_fd, int can_set );
+
+#endif /* __joblimits_h */
@@ -0,0 +1,583 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#include "lineedit.h"
+
+#define MAX_LISTED_MATCHES 200
+
+//Terminal output for one key press, sent with a single write()
+struct out_buf_t {
+    char * data;
+    size_t len;
+    size_t cap;
+};
+
+struct edit_state_t {
+    char * buf;
+    size_t len;
+    size_t cap;
+    size_t pos;              //cursor, 0 <= pos <= len
+    const char * prompt;
+    int hist_index;          //history entry shown, history_size for the new line
+    char * saved_line;       //the new line, while browsing history
+    int last_was_tab;
+};
+
+static const char * builtin_names[] = { "exit", "jobs", "run", "ulimit" };
+
+static void out_append( struct out_buf_t * ob, const char * s, size_t n )
+{
+    if( ob->len + n > ob->cap ) {
+        ob->cap = ( ob->len + n ) * 2;
+        ob->data = ( char * ) realloc( ob->data, ob->cap );
+    }
+    memcpy( ob->data + ob->len, s, n );
+    ob->len += n;
+}
+
+static void out_str( struct out_buf_t * ob, const char * s )
+{
+    out_append( ob, s, strlen( s ) );
+}
+
+static void out_flush( struct out_buf_t * ob )
+{
+    size_t done = 0;
+
+    while( done < ob->len ) {
+        ssize_t n = write( STDOUT_FILENO, ob->data + done, ob->len - done );
+        if( n <= 0 )
+            break;
+        done += n;
+    }
+    ob->len = 0;
+}
+
+static void move_left( struct out_buf_t * ob, size_t n )
+{
+    char seq[ 32 ];
+
+    if( n == 0 )
+        return;
+    if( n == 1 ) {
+        out_str( ob, "\b" );
+        return;
+    }
+    snprintf( seq, sizeof( seq ), "\x1b[%zuD", n );
+    out_str( ob, seq );
+}
+
+static void reserve( struct edit_state_t * st, size_t extra )
+{
+    if( st->len + extra + 1 > st->cap ) {
+        st->cap = ( st->len + extra + 1 ) * 2;
+        st->buf = ( char * ) realloc( st->buf, st->cap );
+    }
+}
+
+static void insert_text( struct edit_state_t * st, struct out_buf_t * ob,
+                         const char * text, size_t n )
+{
+    size_t tail;
+
+    reserve( st, n );
+    memmove( st->buf + st->pos + n, st->buf + st->pos, st->len - st->pos );
+    memcpy( st->buf + st->pos, text, n );
+    st->len += n;
+    st->pos += n;
+    st->buf[ st->len ] = '\0';
+
+    //Typing at the end of the line, the common case, is just an echo
+    tail = st->len - st->pos;
+    out_append( ob, text, n );
+    out_append( ob, st->buf + st->pos, tail );
+    move_left( ob, tail );
+}
+
+//Removes n characters starting at from; the cursor ends up at from
+static void delete_range( struct edit_state_t * st, struct out_buf_t * ob,
+                          size_t from, size_t n )
+{
+    size_t tail;
+
+    move_left( ob, st->pos - from );
+    memmove( st->buf + from, st->buf + from + n, st->len - from - n );
+    st->len -= n;
+    st->pos = from;
+    st->buf[ st->len ] = '\0';
+
+    tail = st->len - st->pos;
+    out_append( ob, st->buf + st->pos, tail );
+    out_str( ob, "\x1b[K" );
+    move_left( ob, tail );
+}
+
+static void replace_line( struct edit_state_t * st, struct out_buf_t * ob, const char * text )
+{
+    size_t n = strlen( text );
+
+    move_left( ob, st->pos );
+    st->len = 0;
+    st->pos = 0;
+    reserve( st, n );
+    memcpy( st->buf, text, n + 1 );
+    st->len = n;
+    st->pos = n;
+    out_append( ob, text, n );
+    out_str( ob, "\x1b[K" );
+}
+
+static void redraw_full( struct edit_state_t * st, struct out_buf_t * ob )
+{
+    out_str( ob, "\r" );
+    out_str( ob, st->prompt );
+    out_append( ob, st->buf, st->len );
+    out_str( ob, "\x1b[K" );
+    move_left( ob, st->len - st->pos );
+}
+
+static void history_move( line_editor_t * ile, struct edit_state_t * st,
+                          struct out_buf_t * ob, int delta )
+{
+    int target = st->hist_index + delta;
+
+    if( target < 0 || target > ile->history_size )
+        return;
+    if( st->hist_index == ile->history_size ) {
+        free( st->saved_line );
+        st->saved_line = strdup( st->buf );
+    }
+    st->hist_index = target;
+    if( target == ile->history_size )
+        replace_line( st, ob, st->saved_line );
+    else
+        replace_line( st, ob, ile->history[ target ] );
+}
+
+static void history_add( line_editor_t * ile, const char * line )
+{
+    const char * p;
+
+    for( p = line; isspace( (unsigned char) *p ); p++ );
+    if( *p == '\0' )
+        return;
+    if( ile->history_size > 0 && strcmp( ile->history[ ile->history_size - 1 ], line ) == 0 )
+        return;
+    if( ile->history_size == ile->history_capacity ) {
+        ile->history_capacity = ( ile->history_capacity == 0 ) ? 64 : ile->history_capacity * 2;
+        ile->history = ( char ** ) realloc( ile->history,
+                                            ile->history_capacity * sizeof( char * ) );
+    }
+    ile->history[ ile->history_size ] = strdup( line );
+    ile->history_size++;
+}
+
+static int compare_strings( const void * a, const void * b )
+{
+    return strcmp( *(char * const *) a, *(char * const *) b );
+}
+
+static void add_match( char *** matches, int * num_matches, char * match )
+{
+    *matches = ( char ** ) realloc( *matches, ( *num_matches + 1 ) * sizeof( char * ) );
+    ( *matches )[ *num_matches ] = match;
+    ( *num_matches )++;
+}
+
+//Commands: builtins plus everything in the PATH index starting with word
+static int complete_command( line_editor_t * ile, const char * word, char *** matches )
+{
+    int num_matches = 0;
+    int first, count, i;
+    size_t word_len = strlen( word );
+
+    *matches = NULL;
+    for( i = 0; i < (int) ( sizeof( builtin_names ) / sizeof( builtin_names[ 0 ] ) ); i++ ) {
+        if( strncmp( builtin_names[ i ], word, word_len ) == 0 )
+            add_match( matches, &num_matches, strdup( builtin_names[ i ] ) );
+    }
+    path_index_refresh( ile->paths );
+    count = path_index_lookup( ile->paths, word, &first );
+    for( i = 0; i < count; i++ )
+        add_match( matches, &num_matches, strdup( ile->paths->names[ first + i ] ) );
+    qsort( *matches, num_matches, sizeof( char * ), compare_strings );
+    return num_matches;
+}
+
+//File names: entries of word's directory starting with its last component.
+//Matches are full words (directory part included); directories end in '/'
+static int complete_file( const char * word, char *** matches )
+{
+    const char * slash = strrchr( word, '/' );
+    const char * base = ( slash == NULL ) ? word : slash + 1;
+    size_t dir_len = ( slash == NULL ) ? 0 : (size_t) ( slash - word + 1 );
+    size_t base_len = strlen( base );
+    char * dir;
+    DIR * d;
+    struct dirent * entry;
+    struct stat st;
+    int num_matches = 0;
+
+    *matches = NULL;
+    dir = ( char * ) malloc( dir_len + 2 );
+    if( dir_len == 0 )
+        strcpy( dir, "." );
+    else {
+        memcpy( dir, word, dir_len );
+        dir[ dir_len ] = '\0';
+    }
+    d = opendir( dir );
+    if( d == NULL ) {
+        free( dir );
+        return 0;
+    }
+    while( ( entry = readdir( d ) ) != NULL ) {
+        char * match;
+        size_t name_len = strlen( entry->d_name );
+        if( strncmp( entry->d_name, base, base_len ) != 0 )
+            continue;
+        if( entry->d_name[ 0 ] == '.' && base[ 0 ] != '.' )
+            continue;
+        if( strcmp( entry->d_name, "." ) == 0 || strcmp( entry->d_name, ".." ) == 0 )
+            continue;
+        match = ( char * ) malloc( dir_len + name_len + 2 );
+        memcpy( match, word, dir_len );
+        memcpy( match + dir_len, entry->d_name, name_len + 1 );
+        if( fstatat( dirfd( d ), entry->d_name, &st, 0 ) == 0 && S_ISDIR( st.st_mode ) )
+            strcat( match, "/" );
+        add_match( matches, &num_matches, match );
+    }
+    closedir( d );
+    free( dir );
+    qsort( *matches, num_matches, sizeof( char * ), compare_strings );
+    return num_matches;
+}
+
+static void list_matches( struct out_buf_t * ob, char ** matches, int num_matches )
+{
+    struct winsize ws;
+    size_t width = 80;
+    size_t col = 0;
+    int i;
+
+    if( ioctl( STDOUT_FILENO, TIOCGWINSZ, &ws ) == 0 && ws.ws_col > 0 )
+        width = ws.ws_col;
+    out_str( ob, "\n" );
+    for( i = 0; i < num_matches && i < MAX_LISTED_MATCHES; i++ ) {
+        size_t n = strlen( matches[ i ] );
+        if( col > 0 && col + 2 + n > width ) {
+            out_str( ob, "\n" );
+            col = 0;
+        }
+        if( col > 0 ) {
+            out_str( ob, "  " );
+            col += 2;
+        }
+        out_append( ob, matches[ i ], n );
+        col += n;
+    }
+    if( num_matches > MAX_LISTED_MATCHES )
+        out_str( ob, "\n..." );
+    out_str( ob, "\n" );
+}
+
+static void complete( line_editor_t * ile, struct edit_state_t * st, struct out_buf_t * ob )
+{
+    size_t start = st->pos;
+    size_t before;
+    char * word;
+    char ** matches;
+    int num_matches;
+    size_t common;
+    size_t word_len;
+    int i;
+
+    while( start > 0 && st->buf[ start - 1 ] != ' ' )
+        start--;
+    word_len = st->pos - start;
+    word = ( char * ) malloc( word_len + 1 );
+    memcpy( word, st->buf + start, word_len );
+    word[ word_len ] = '\0';
+
+    //A word is a command at the start of the line or right after a pipe
+    before = start;
+    while( before > 0 && st->buf[ before - 1 ] == ' ' )
+        before--;
+    if( strchr( word, '/' ) == NULL && ( before == 0 || st->buf[ before - 1 ] == '|' ) )
+        num_matches = complete_command( ile, word, &matches );
+    else
+        num_matches = complete_file( word, &matches );
+
+    if( num_matches == 0 ) {
+        out_str( ob, "\a" );
+    }
+    else {
+        common = strlen( matches[ 0 ] );
+        for( i = 1; i < num_matches; i++ ) {
+            size_t j = 0;
+            while( j < common && matches[ i ][ j ] == matches[ 0 ][ j ] )
+                j++;
+            common = j;
+        }
+        if( common > word_len )
+            insert_text( st, ob, matches[ 0 ] + word_len, common - word_len );
+        if( num_matches == 1 ) {
+            if( matches[ 0 ][ common - 1 ] != '/' )
+                insert_text( st, ob, " ", 1 );
+        }
+        else if( common == word_len ) {
+            //Nothing left to insert: list the choices on the second tab
+            if( st->last_was_tab ) {
+                list_matches( ob, matches, num_matches );
+                redraw_full( st, ob );
+            }
+            else {
+                out_str( ob, "\a" );
+            }
+        }
+    }
+
+    for( i = 0; i < num_matches; i++ )
+        free( matches[ i ] );
+    free( matches );
+    free( word );
+}
+
+//Handles the rest of an escape sequence; returns 0 if it wasn't recognized
+static int handle_escape( line_editor_t * ile, struct edit_state_t * st, struct out_buf_t * ob )
+{
+    char seq[ 3 ];
+
+    if( read( STDIN_FILENO, &seq[ 0 ], 1 ) != 1 || read( STDIN_FILENO, &seq[ 1 ], 1 ) != 1 )
+        return 0;
+    if( seq[ 0 ] == '[' && seq[ 1 ] >= '0' && seq[ 1 ] <= '9' ) {
+        //ESC [ n ~
+        if( read( STDIN_FILENO, &seq[ 2 ], 1 ) != 1 || seq[ 2 ] != '~' )
+            return 0;
+        switch( seq[ 1 ] ) {
+        case '1': case '7': seq[ 1 ] = 'H'; break;
+        case '4': case '8': seq[ 1 ] = 'F'; break;
+        case '3':
+            if( st->pos < st->len )
+                delete_range( st, ob, st->pos, 1 );
+            return 1;
+        default:
+            return 0;
+        }
+    }
+    else if( seq[ 0 ] != '[' && seq[ 0 ] != 'O' ) {
+        return 0;
+    }
+
+    switch( seq[ 1 ] ) {
+    case 'A':
+        history_move( ile, st, ob, -1 );
+        break;
+    case 'B':
+        history_move( ile, st, ob, 1 );
+        break;
+    case 'C':
+        //Reprinting the character under the cursor moves right in one byte
+        if( st->pos < st->len ) {
+            out_append( ob, st->buf + st->pos, 1 );
+            st->pos++;
+        }
+        break;
+    case 'D':
+        if( st->pos > 0 ) {
+            move_left( ob, 1 );
+            st->pos--;
+        }
+        break;
+    case 'H':
+        move_left( ob, st->pos );
+        st->pos = 0;
+        break;
+    case 'F':
+        out_append( ob, st->buf + st->pos, st->len - st->pos );
+        st->pos = st->len;
+        break;
+    default:
+        return 0;
+    }
+    return 1;
+}
+
+line_editor_t * line_editor_create( void )
+{
+    line_editor_t * new_le = ( line_editor_t * )malloc(sizeof(line_editor_t));
+    new_le->history = NULL;
+    new_le->history_size = 0;
+    new_le->history_capacity = 0;
+    new_le->paths = path_index_create();
+    new_le->wait_input = NULL;
+    new_le->wait_arg = NULL;
+    new_le->cancelled = 0;
+    return new_le;
+}
+
+void line_editor_set_wait( line_editor_t * ile, int ( * wait_input )( void * arg ), void * arg )
+{
+    ile->wait_input = wait_input;
+    ile->wait_arg = arg;
+}
+
+void line_editor_delete( line_editor_t * ile )
+{
+    int i;
+
+    for( i = 0; i < ile->history_size; i++ )
+        free( ile->history[ i ] );
+    free( ile->history );
+    path_index_delete( ile->paths );
+    free( ile );
+}
+
+char * line_editor_read( line_editor_t * ile, const char * prompt )
+{
+    struct termios saved, raw;
+    struct edit_state_t st;
+    struct out_buf_t ob = { NULL, 0, 0 };
+    int at_eof = 0;
+    char c;
+
+    if( tcgetattr( STDIN_FILENO, &saved ) == -1 )
+        return NULL;
+    raw = saved;
+    raw.c_iflag &= ~( BRKINT | ICRNL | INPCK | ISTRIP | IXON );
+    raw.c_cflag |= CS8;
+    raw.c_lflag &= ~( ECHO | ICANON | IEXTEN | ISIG );
+    raw.c_cc[ VMIN ] = 1;
+    raw.c_cc[ VTIME ] = 0;
+    tcsetattr( STDIN_FILENO, TCSADRAIN, &raw );
+
+    st.cap = 256;
+    st.buf = ( char * ) malloc( st.cap );
+    st.buf[ 0 ] = '\0';
+    st.len = 0;
+    st.pos = 0;
+    st.prompt = prompt;
+    st.hist_index = ile->history_size;
+    st.saved_line = NULL;
+    st.last_was_tab = 0;
+    ile->cancelled = 0;
+
+    while( 1 ) {
+        int is_tab = 0;
+        if( ile->wait_input != NULL )
+            ile->wait_input( ile->wait_arg );
+        if( read( STDIN_FILENO, &c, 1 ) != 1 ) {
+            at_eof = 1;
+            break;
+        }
+        if( c == '\r' || c == '\n' ) {
+            out_str( &ob, "\n" );
+            break;
+        }
+        switch( c ) {
+        case CTRL( 'D' ):
+            if( st.len == 0 ) {
+                at_eof = 1;
+                break;
+            }
+            if( st.pos < st.len )
+                delete_range( &st, &ob, st.pos, 1 );
+            break;
+        case CTRL( 'C' ):
+            //Drop the line; the caller prints a fresh prompt
+            out_str( &ob, "^C\n" );
+            st.len = 0;
+            st.pos = 0;
+            st.buf[ 0 ] = '\0';
+            ile->cancelled = 1;
+            break;
+        case 127:
+        case CTRL( 'H' ):
+            if( st.pos > 0 )
+                delete_range( &st, &ob, st.pos - 1, 1 );
+            break;
+        case CTRL( 'A' ):
+            move_left( &ob, st.pos );
+            st.pos = 0;
+            break;
+        case CTRL( 'E' ):
+            out_append( &ob, st.buf + st.pos, st.len - st.pos );
+            st.pos = st.len;
+            break;
+        case CTRL( 'B' ):
+            if( st.pos > 0 ) {
+                move_left( &ob, 1 );
+                st.pos--;
+            }
+            break;
+        case CTRL( 'F' ):
+            if( st.pos < st.len ) {
+                out_append( &ob, st.buf + st.pos, 1 );
+                st.pos++;
+            }
+            break;
+        case CTRL( 'K' ):
+            st.len = st.pos;
+            st.buf[ st.len ] = '\0';
+            out_str( &ob, "\x1b[K" );
+            break;
+        case CTRL( 'U' ):
+            delete_range( &st, &ob, 0, st.pos );
+            break;
+        case CTRL( 'W' ): {
+            size_t from = st.pos;
+            while( from > 0 && st.buf[ from - 1 ] == ' ' )
+                from--;
+            while( from > 0 && st.buf[ from - 1 ] != ' ' )
+                from--;
+            delete_range( &st, &ob, from, st.pos - from );
+            break;
+        }
+        case CTRL( 'L' ):
+            out_str( &ob, "\x1b[H\x1b[2J" );
+            redraw_full( &st, &ob );
+            break;
+        case CTRL( 'P' ):
+            history_move( ile, &st, &ob, -1 );
+            break;
+        case CTRL( 'N' ):
+            history_move( ile, &st, &ob, 1 );
+            break;
+        case '\t':
+            complete( ile, &st, &ob );
+            is_tab = 1;
+            break;
+        case 27:
+            if( !handle_escape( ile, &st, &ob ) )
+                out_str( &ob, "\a" );
+            break;
+        default:
+            if( (unsigned char) c >= 32 )
+                insert_text( &st, &ob, &c, 1 );
+            break;
+        }
+        st.last_was_tab = is_tab;
+        out_flush( &ob );
+        if( at_eof || ile->cancelled )
+            break;
+    }
+    out_flush( &ob );
+    tcsetattr( STDIN_FILENO, TCSADRAIN, &saved );
+
+    free( ob.data );
+    free( st.saved_line );
+    if( at_eof ) {
+        free( st.buf );
+        return NULL;
+    }
+    if( !ile->cancelled )
+        history_add( ile, st.buf );
+    return st.buf;
+}
@@ -0,0 +1,39 @@
+#if !defined( __lineedit_h )
+#define __lineedit_h 1
+
+#include "pathindex.h"
+
+/* Raw-mode line editor for interactive use: cursor movement, history and
+ * tab completion of commands (from a path_index_t) and file names. Each key
+ * redraws only the part of the line it changed, in a single write(), so
+ * editing stays responsive over slow links. Lines longer than the terminal
+ * is wide are not re-wrapped.
+ */
+typedef struct {
+    char ** history;
+    int history_size;
+    int history_capacity;
+    path_index_t * paths;
+    int ( * wait_input )( void * arg ); //called before each read of a key
+    void * wait_arg;
+    int cancelled;                      //the last read ended with Ctrl-C
+} line_editor_t;
+
+line_editor_t * line_editor_create( void );
+void line_editor_delete( line_editor_t * ile );
+
+/* line_editor_set_wait(): lets the caller do other work while the editor is
+ * idle; wait_input(arg) should return once stdin is readable
+ */
+void line_editor_set_wait( line_editor_t * ile, int ( * wait_input )( void * arg ), void * arg );
+
+/* line_editor_read(): reads one line from the terminal on stdin
+ * input: prompt, already printed by the caller; it is only reprinted when the
+ *   whole line has to be redrawn
+ * return value: malloc'd line without its newline, or NULL at end of input.
+ *   Ctrl-C returns an empty line with ile->cancelled set, so the caller can
+ *   drop whatever it had gathered from earlier lines too
+ */
+char * line_editor_read( line_editor_t * ile, const char * prompt );
+
+#endif /* __lineedit_h */
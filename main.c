@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "simsh.h"
+#include "lineedit.h"
+
+//Per-job ring for a bare --capture
+#define DEFAULT_CAPTURE_SIZE (16 * 1024)
+
+
+//Blocks until stdin has input, draining captured background output meanwhile
+int waitInput(void* ctx){
+    return simsh_poll((simsh_ctx_t*) ctx, STDIN_FILENO, -1);
+}
+
+//editor is NULL unless stdin and stdout are a terminal; scripts and pipes
+//are read in cooked mode a character at a time. capture_ctx is set when
+//background output is captured; stdin is unbuffered then, so waiting on the
+//descriptor before each character is exact. Returns NULL at end of input
+char* getRawCmd(line_editor_t* editor, const char* prompt, simsh_ctx_t* capture_ctx){
+    if(editor != NULL){
+        return line_editor_read(editor, prompt);
+    }
+
+    size_t buff_size = 256;
+    size_t char_index = 0;
+    char *buffer = (char *) malloc(buff_size);
+
+
+    int c;
+    while(1){
+        if(capture_ctx != NULL) waitInput(capture_ctx);
+        if((c = getchar()) == '\n') break;
+        if(c == EOF){
+            free(buffer);
+            return NULL;
+        }
+        buffer[char_index] = c;
+        char_index++;
+        if(char_index >= buff_size){
+            buff_size *= 2;
+            buffer = (char *) realloc(buffer, buff_size);
+        }
+    }
+    buffer[char_index] = '\0';
+    return buffer;
+}
+
+
+
+//"[job-...] cpu 1.234s, memory 5.6M" for a finished run --cpu/--mem job
+void printStats(void* arg, const simsh_job_stats_t* stats){
+    printf("[%s] cpu %.3fs, memory %.1fM\n", stats->name,
+           stats->cpu_usec < 0 ? 0.0 : stats->cpu_usec / 1e6,
+           stats->memory_peak < 0 ? 0.0 : stats->memory_peak / (1024.0 * 1024.0));
+    fflush(stdout);
+}
+
+//Ring size for --capture[=SIZE]: bytes, or a number with a k or m suffix.
+//Returns 0 if the size is invalid
+size_t captureSize(const char* value){
+    char* end;
+    unsigned long size = strtoul(value, &end, 10);
+    if(end == value) return 0;
+    if(*end == 'k' || *end == 'K'){
+        size *= 1024;
+        end++;
+    }
+    else if(*end == 'm' || *end == 'M'){
+        size *= 1024 * 1024;
+        end++;
+    }
+    return (*end == '\0') ? size : 0;
+}
+
+//Level named by the program: simsh1, simsh2 and simsh3 are links to the same
+//binary. A name above what was compiled in (simsh3 from a LEVEL=1 build) gets
+//the highest level there is. Returns 0 for any other name
+int levelFromName(const char* argv0){
+    const char* name = strrchr(argv0, '/');
+    name = (name == NULL) ? argv0 : name + 1;
+    if(strncmp(name, "simsh", 5) == 0 && name[5] >= '1' && name[5] <= '9' && name[6] == '\0'){
+        int level = name[5] - '0';
+        return (level > simsh_max_level()) ? simsh_max_level() : level;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]){
+    simsh_ctx_t* ctx = simsh_ctx_create();
+    int level = levelFromName(argv[0]);
+    size_t capture_size = 0;
+
+    //--level=N (or --level N) overrides the name
+    int i;
+    for(i = 1; i < argc; i++){
+        if(strncmp(argv[i], "--level=", 8) == 0){
+            level = atoi(argv[i] + 8);
+        }
+        else if(strcmp(argv[i], "--level") == 0 && i + 1 < argc){
+            level = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--capture") == 0){
+            capture_size = DEFAULT_CAPTURE_SIZE;
+        }
+        else if(strncmp(argv[i], "--capture=", 10) == 0 && (capture_size = captureSize(argv[i] + 10)) > 0){
+            continue;
+        }
+        else{
+            printf("usage: %s [--level=1|2|3] [--capture[=SIZE]]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(level != 0 && simsh_ctx_set_level(ctx, level) != 0){
+        printf("%s: level must be between 1 and %d\n", argv[0], simsh_max_level());
+        return 1;
+    }
+    simsh_ctx_set_stats_callback(ctx, printStats, NULL);
+    simsh_ctx_t* capture_ctx = NULL;
+    if(capture_size > 0){
+        simsh_ctx_set_capture(ctx, capture_size);
+        capture_ctx = ctx;
+        setvbuf(stdin, NULL, _IONBF, 0);
+    }
+    line_editor_t* editor = NULL;
+    if(isatty(STDIN_FILENO) && isatty(STDOUT_FILENO)){
+        editor = line_editor_create();
+        if(capture_ctx != NULL) line_editor_set_wait(editor, waitInput, capture_ctx);
+    }
+    //Lines that leave an if/while/for/case/function open are gathered here
+    //until the block is closed, then run as one script
+    char* script = NULL;
+    while(1){
+        const char* prompt = (script == NULL) ? "mysh: " : "> ";
+        simsh_reap(ctx);
+        printf("%s", prompt);
+        fflush(stdout);
+        char* raw_cmd = getRawCmd(editor, prompt, capture_ctx);
+        if(raw_cmd == NULL) break;
+        //Ctrl-C abandons the whole block, not just the line being typed
+        if(editor != NULL && editor->cancelled){
+            free(raw_cmd);
+            free(script);
+            script = NULL;
+            continue;
+        }
+        if(script != NULL){
+            size_t len = strlen(script);
+            script = (char *) realloc(script, len + strlen(raw_cmd) + 2);
+            script[len] = '\n';
+            strcpy(script + len + 1, raw_cmd);
+            free(raw_cmd);
+            raw_cmd = script;
+        }
+        script = NULL;
+
+        simsh_result_t result;
+        if(simsh_run_line(ctx, raw_cmd, &result) != 0){
+            if(result.incomplete){
+                script = raw_cmd;
+                continue;
+            }
+            printf("%s\n", result.error);
+        }
+        else{
+            if(result.error[0] != '\0') printf("%s\n", result.error);
+            if(result.warning[0] != '\0') printf("%s\n", result.warning);
+            if(result.has_stats) printStats(NULL, &result.stats);
+            if(result.job_id != 0) printf("[%d] %d\n", result.job_id, result.last_pid);
+        }
+        free(raw_cmd);
+        fflush(stdout);
+        if(result.exit_requested) break;
+    }
+    if(script != NULL){
+        printf("%s\n", "Unexpected end of script");
+        free(script);
+    }
+    //Wait for all background processes to finish
+    simsh_wait_background(ctx);
+    simsh_ctx_destroy(ctx);
+    if(editor != NULL) line_editor_delete(editor);
+    return 0;
+}
@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "parse.h"
+
+int isSpecialToken(char *token, int features){
+    if(strcmp(token, "&") == 0) return 1;
+#if SIMSH_MAX_LEVEL >= 3
+    if((features & PARSE_PIPE) && strcmp(token, "|") == 0) return 1;
+#endif
+#if SIMSH_MAX_LEVEL >= 2
+    redir_t redir;
+    if((features & PARSE_REDIRECT) && redir_parse_operator(token, &redir)) return 1;
+#endif
+    return 0;
+}
+
+cmd_obj* createEmptyCmd(int argv_count){
+    char **argv = (char **) malloc(sizeof(char*)*argv_count);
+
+    cmd_obj* new_cmd = (cmd_obj*) malloc(sizeof(cmd_obj));
+#if SIMSH_MAX_LEVEL >= 2
+    new_cmd->redirs = redir_list_create();
+#else
+    new_cmd->redirs = NULL;
+#endif
+    limits_init(&new_cmd->limits);
+    new_cmd->is_background = 0;
+    new_cmd->next_cmd = NULL;
+    new_cmd->argv = argv;
+    return new_cmd;
+}
+
+#if SIMSH_MAX_LEVEL >= 2
+//Adds a redirection to the current command, rejecting the combinations that
+//can't mean anything: two files on stdin/stdout, or a file on a stream that
+//is already connected to a pipe. Returns 0 (with a message in error) if the
+//redirection was rejected
+int addRedirect(cmd_obj* curr_cmd, cmd_obj* first_cmd, redir_t* redir, char* error, size_t error_size){
+    if(redir->kind == REDIR_OPEN && redir->fd == STDIN_FILENO){
+        if(curr_cmd != first_cmd || redir_list_opens(curr_cmd->redirs, STDIN_FILENO)){
+            snprintf(error, error_size, "Ambiguous input redirect");
+            return 0;
+        }
+    }
+    if(redir->kind == REDIR_OPEN && redir->fd == STDOUT_FILENO){
+        if(redir_list_opens(curr_cmd->redirs, STDOUT_FILENO)){
+            snprintf(error, error_size, "Ambiguous output redirect");
+            return 0;
+        }
+    }
+    redir_list_append(curr_cmd->redirs, redir);
+    return 1;
+}
+#endif
+
+void freeCmd(cmd_obj* cmd){
+    while(cmd != NULL){
+        cmd_obj* next_cmd = cmd->next_cmd;
+#if SIMSH_MAX_LEVEL >= 2
+        redir_list_delete(cmd->redirs);
+#endif
+        free(cmd->argv);
+        free(cmd);
+        cmd = next_cmd;
+    }
+}
+
+cmd_obj* processCmd(chopped_line_t* chop_cmd, int features, char* error, size_t error_size){
+    int i;
+    int cmd_valid = 1;
+    int is_background = 0;
+
+    //Redirection still waiting for its file name
+#if SIMSH_MAX_LEVEL >= 2
+    redir_t pending;
+#endif
+    int has_pending = 0;
+
+    //Max possible size of argv, based on num_tokens
+    int argv_max_size = chop_cmd->num_tokens + 1;
+    cmd_obj* curr_cmd = createEmptyCmd(argv_max_size);
+    cmd_obj* first_cmd = curr_cmd;
+    cmd_obj* prev_cmd;
+
+    
+    int arg_index = 0;
+    i = 0;
+    //run --cpu=N --mem=SIZE ... cmd: the options apply to the whole job
+    if(strcmp(chop_cmd->tokens[0], "run") == 0){
+        for(i = 1; i < chop_cmd->num_tokens && strncmp(chop_cmd->tokens[i], "--", 2) == 0; i++){
+            if(limits_parse_option(chop_cmd->tokens[i], &first_cmd->limits, error, error_size) == -1){
+                freeCmd(first_cmd);
+                return 0;
+            }
+        }
+        if(i == chop_cmd->num_tokens){
+            snprintf(error, error_size, "run: missing command");
+            freeCmd(first_cmd);
+            return 0;
+        }
+    }
+    for(; i < chop_cmd->num_tokens; i++){
+        char* curr_token = chop_cmd->tokens[i];
+        
+        //Check for the & operator and fail if it's not the last token
+        if(strcmp(curr_token, "&") == 0){
+            if(i != (chop_cmd->num_tokens - 1)){
+                //& is not the last token, error
+                snprintf(error, error_size, "Operator & must appear at end of command line");
+                cmd_valid = 0;
+                break;
+            }
+            is_background = 1; 
+        }
+
+        if(!isSpecialToken(curr_token, features)){
+            if(!has_pending){
+                curr_cmd->argv[arg_index] = curr_token;
+                arg_index++;
+            }
+#if SIMSH_MAX_LEVEL >= 2
+            else{
+                pending.filename = curr_token;
+                has_pending = 0;
+                if(!addRedirect(curr_cmd, first_cmd, &pending, error, error_size)){
+                    cmd_valid = 0;
+                    break;
+                }
+            }
+#endif
+        }
+        else{
+            //Check to make sure there are no trailing redirect operators in the previous command
+            if(has_pending){
+                snprintf(error, error_size, "Missing name for redirect");
+                cmd_valid = 0;
+                break;
+            }
+            if(strcmp(curr_token, "|") == 0){
+                //Every stage needs a program to run
+                if(arg_index == 0){
+                    snprintf(error, error_size, "Invalid null command");
+                    cmd_valid = 0;
+                    break;
+                }
+#if SIMSH_MAX_LEVEL >= 2
+                //stdout already goes to a file, so it can't also feed the pipe
+                if(redir_list_opens(curr_cmd->redirs, STDOUT_FILENO)){
+                    snprintf(error, error_size, "Ambiguous output redirect");
+                    cmd_valid = 0;
+                    break;
+                }
+#endif
+                curr_cmd->argv[arg_index] = NULL;
+                prev_cmd = curr_cmd;
+                curr_cmd = createEmptyCmd(argv_max_size);
+                arg_index = 0;
+                prev_cmd->next_cmd = curr_cmd;
+            }
+#if SIMSH_MAX_LEVEL >= 2
+            else if(strcmp(curr_token, "&") != 0){
+                redir_t redir;
+                int redir_type = redir_parse_operator(curr_token, &redir);
+                if(redir_type == 2){
+                    pending = redir;
+                    has_pending = 1;
+                }
+                else if(redir_type == 1){
+                    if(!addRedirect(curr_cmd, first_cmd, &redir, error, error_size)){
+                        cmd_valid = 0;
+                        break;
+                    }
+                }
+            }
+#endif
+        }
+    }
+    //Check to make sure there is no trailing redirect operator
+    if(has_pending && cmd_valid){
+        snprintf(error, error_size, "Missing name for redirect");
+        cmd_valid = 0;
+    }
+    if(arg_index == 0 && cmd_valid){
+        snprintf(error, error_size, "Invalid null command");
+        cmd_valid = 0;
+    }
+    curr_cmd->argv[arg_index] = NULL;
+   
+    if(cmd_valid){
+        first_cmd->is_background = is_background;
+        return first_cmd;
+    }
+    else{
+        freeCmd(first_cmd);
+        return 0;
+    }
+
+}
@@ -0,0 +1,41 @@
+#if !defined( __parse_h )
+#define __parse_h 1
+
+#include <stddef.h>
+
+#include "chop_line.h"
+#include "redirect.h"
+#include "joblimits.h"
+
+//Optional syntax, switched on per shell level (see simsh_ctx_set_level())
+#define PARSE_REDIRECT 0x1  //<, >, >>, 2>&1, ...
+#define PARSE_PIPE     0x2  //|
+
+//SIMSH_MAX_LEVEL compiles out the syntax above a level: 1 leaves only
+//foreground/background jobs, 2 adds redirection, 3 (default) adds pipes.
+//Operators that are compiled out or switched off are ordinary words
+#if !defined( SIMSH_MAX_LEVEL )
+#define SIMSH_MAX_LEVEL 3
+#endif
+
+typedef struct cmd_obj{
+    char** argv;
+    redir_list_t* redirs; //n<, n>, n>>, &>, n>&m ... in the order given; NULL below level 2
+    int is_background;
+    job_limits_t limits; //set by the run builtin, only used on the first command
+    struct cmd_obj* next_cmd;
+} cmd_obj;
+
+/* processCmd(): turns a chopped line into a linked list of pipeline stages
+ * input: chopped_line_t from get_chopped_line(); the stages point into its
+ *   tokens, so it must outlive the returned list. features is a mask of
+ *   PARSE_* flags. error receives the reason a line is rejected (without a
+ *   newline)
+ * return value: first stage of the pipeline, or NULL if the line is invalid
+ */
+cmd_obj* processCmd(chopped_line_t* chop_cmd, int features, char* error, size_t error_size);
+
+/* freeCmd(): frees every stage of a pipeline returned by processCmd() */
+void freeCmd(cmd_obj* cmd);
+
+#endif /* __parse_h */
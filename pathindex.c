@@ -0,0 +1,188 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "pathindex.h"
+
+static int compare_names( const void * a, const void * b )
+{
+    return strcmp( *(char * const *) a, *(char * const *) b );
+}
+
+static void clear_index( path_index_t * iindex )
+{
+    int i;
+
+    for( i = 0; i < iindex->size; i++ )
+        free( iindex->names[ i ] );
+    free( iindex->names );
+    free( iindex->path );
+    free( iindex->mtimes );
+    iindex->names = NULL;
+    iindex->size = 0;
+    iindex->path = NULL;
+    iindex->mtimes = NULL;
+    iindex->num_dirs = 0;
+}
+
+//Adds the executables in one directory to the (still unsorted) name array
+static void scan_dir( path_index_t * iindex, const char * dir, int * capacity )
+{
+    DIR * d = opendir( dir );
+    struct dirent * entry;
+    struct stat st;
+
+    if( d == NULL )
+        return;
+    while( ( entry = readdir( d ) ) != NULL ) {
+        if( entry->d_name[ 0 ] == '.' )
+            continue;
+        if( fstatat( dirfd( d ), entry->d_name, &st, 0 ) == -1 )
+            continue;
+        if( !S_ISREG( st.st_mode ) || !( st.st_mode & ( S_IXUSR | S_IXGRP | S_IXOTH ) ) )
+            continue;
+        if( iindex->size == *capacity ) {
+            *capacity = ( *capacity == 0 ) ? 256 : *capacity * 2;
+            iindex->names = ( char ** ) realloc( iindex->names, *capacity * sizeof( char * ) );
+        }
+        iindex->names[ iindex->size ] = strdup( entry->d_name );
+        iindex->size++;
+    }
+    closedir( d );
+}
+
+//Splits a copy of $PATH on ':'; an empty entry means the current directory
+static int split_path( char * path_copy, char *** dirs )
+{
+    int num_dirs = 1;
+    char * p;
+    int i = 0;
+
+    for( p = path_copy; *p != '\0'; p++ )
+        if( *p == ':' ) num_dirs++;
+    *dirs = ( char ** ) malloc( num_dirs * sizeof( char * ) );
+    ( *dirs )[ i++ ] = path_copy;
+    for( p = path_copy; *p != '\0'; p++ ) {
+        if( *p == ':' ) {
+            *p = '\0';
+            ( *dirs )[ i++ ] = p + 1;
+        }
+    }
+    for( i = 0; i < num_dirs; i++ )
+        if( ( *dirs )[ i ][ 0 ] == '\0' ) ( *dirs )[ i ] = ".";
+    return num_dirs;
+}
+
+static void rebuild( path_index_t * iindex, const char * path )
+{
+    char * path_copy = strdup( path );
+    char ** dirs;
+    int capacity = 0;
+    int num_dirs;
+    int i, j;
+    struct stat st;
+
+    clear_index( iindex );
+    iindex->path = strdup( path );
+    num_dirs = split_path( path_copy, &dirs );
+    iindex->num_dirs = num_dirs;
+    iindex->mtimes = ( struct timespec * ) calloc( num_dirs, sizeof( struct timespec ) );
+
+    for( i = 0; i < num_dirs; i++ ) {
+        //Take the mtime before the scan so a change during it is seen next time
+        if( stat( dirs[ i ], &st ) == 0 )
+            iindex->mtimes[ i ] = st.st_mtim;
+        scan_dir( iindex, dirs[ i ], &capacity );
+    }
+
+    qsort( iindex->names, iindex->size, sizeof( char * ), compare_names );
+    //Names found in several directories only need to be offered once
+    for( i = 0, j = 0; i < iindex->size; i++ ) {
+        if( j > 0 && strcmp( iindex->names[ j - 1 ], iindex->names[ i ] ) == 0 )
+            free( iindex->names[ i ] );
+        else
+            iindex->names[ j++ ] = iindex->names[ i ];
+    }
+    iindex->size = j;
+
+    free( dirs );
+    free( path_copy );
+}
+
+path_index_t * path_index_create( void )
+{
+    path_index_t * new_index = ( path_index_t * )malloc(sizeof(path_index_t));
+    new_index->names = NULL;
+    new_index->size = 0;
+    new_index->path = NULL;
+    new_index->mtimes = NULL;
+    new_index->num_dirs = 0;
+    path_index_refresh( new_index );
+    return new_index;
+}
+
+void path_index_delete( path_index_t * iindex )
+{
+    clear_index( iindex );
+    free( iindex );
+}
+
+void path_index_refresh( path_index_t * iindex )
+{
+    const char * path = getenv( "PATH" );
+    char * path_copy;
+    char ** dirs;
+    int num_dirs;
+    int i;
+    int stale = 0;
+    struct stat st;
+
+    if( path == NULL )
+        path = "";
+    if( iindex->path == NULL || strcmp( iindex->path, path ) != 0 ) {
+        rebuild( iindex, path );
+        return;
+    }
+
+    path_copy = strdup( path );
+    num_dirs = split_path( path_copy, &dirs );
+    for( i = 0; i < num_dirs && !stale; i++ ) {
+        struct timespec mtime = { 0, 0 };
+        if( stat( dirs[ i ], &st ) == 0 )
+            mtime = st.st_mtim;
+        if( mtime.tv_sec != iindex->mtimes[ i ].tv_sec ||
+            mtime.tv_nsec != iindex->mtimes[ i ].tv_nsec )
+            stale = 1;
+    }
+    free( dirs );
+    free( path_copy );
+    if( stale )
+        rebuild( iindex, path );
+}
+
+int path_index_lookup( const path_index_t * iindex, const char * prefix, int * first )
+{
+    size_t prefix_len = strlen( prefix );
+    int lo = 0;
+    int hi = iindex->size;
+    int end;
+
+    //Lower bound of prefix; every match sorts at or after it
+    while( lo < hi ) {
+        int mid = lo + ( hi - lo ) / 2;
+        if( strcmp( iindex->names[ mid ], prefix ) < 0 )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for( end = lo; end < iindex->size; end++ ) {
+        if( strncmp( iindex->names[ end ], prefix, prefix_len ) != 0 )
+            break;
+    }
+    *first = lo;
+    return end - lo;
+}
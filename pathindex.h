@@ -0,0 +1,32 @@
+#if !defined( __pathindex_h )
+#define __pathindex_h 1
+
+#include <time.h>
+
+/* Sorted index of the executable names found on $PATH, for completion.
+ * Built once, then rebuilt only when $PATH changes or one of its
+ * directories has a new mtime (a program was added or removed).
+ */
+typedef struct {
+    char ** names;             //sorted, without duplicates
+    int size;
+    char * path;               //$PATH the index was built from
+    struct timespec * mtimes;  //mtime of each $PATH directory, in order
+    int num_dirs;
+} path_index_t;
+
+path_index_t * path_index_create( void );
+void path_index_delete( path_index_t * iindex );
+
+/* path_index_refresh(): rebuilds the index if it has gone stale
+ * Costs one stat() per $PATH directory when nothing changed.
+ */
+void path_index_refresh( path_index_t * iindex );
+
+/* path_index_lookup(): finds the names starting with prefix
+ * return value: number of matches; *first receives the index of the first
+ *   one, and the matches are names[ *first ] .. names[ *first + count - 1 ]
+ */
+int path_index_lookup( const path_index_t * iindex, const char * prefix, int * first );
+
+#endif /* __pathindex_h */
@@ -0,0 +1,235 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "redirect.h"
+#include "childmsg.h"
+
+//Larger descriptor numbers are taken as ordinary words
+#define REDIR_MAX_FD 65535
+
+int redir_parse_operator( const char * token, redir_t * out )
+{
+    const char * p = token;
+    int fd = -1;
+
+    memset( out, 0, sizeof( redir_t ) );
+
+    if( strcmp( token, "&>" ) == 0 ) {
+        out->kind = REDIR_OPEN;
+        out->fd = STDOUT_FILENO;
+        out->flags = O_WRONLY | O_CREAT | O_EXCL;
+        out->both = 1;
+        return 2;
+    }
+    if( strcmp( token, "&>>" ) == 0 ) {
+        out->kind = REDIR_OPEN;
+        out->fd = STDOUT_FILENO;
+        out->flags = O_WRONLY | O_CREAT | O_APPEND;
+        out->both = 1;
+        return 2;
+    }
+
+    //Optional leading descriptor number
+    if( isdigit( (unsigned char) *p ) ) {
+        fd = 0;
+        while( isdigit( (unsigned char) *p ) ) {
+            fd = fd * 10 + ( *p - '0' );
+            if( fd > REDIR_MAX_FD )
+                return 0;
+            p++;
+        }
+    }
+
+    if( *p == '<' ) {
+        out->fd = ( fd == -1 ) ? STDIN_FILENO : fd;
+        p++;
+        if( *p == '\0' ) {
+            out->kind = REDIR_OPEN;
+            out->flags = O_RDONLY;
+            return 2;
+        }
+    }
+    else if( *p == '>' ) {
+        out->fd = ( fd == -1 ) ? STDOUT_FILENO : fd;
+        p++;
+        if( *p == '\0' ) {
+            //Plain > refuses to clobber an existing file
+            out->kind = REDIR_OPEN;
+            out->flags = O_WRONLY | O_CREAT | O_EXCL;
+            return 2;
+        }
+        if( strcmp( p, ">" ) == 0 ) {
+            out->kind = REDIR_OPEN;
+            out->flags = O_WRONLY | O_CREAT | O_APPEND;
+            return 2;
+        }
+    }
+    else {
+        return 0;
+    }
+
+    //Remaining forms are n>&m, n<&m and n>&-
+    if( *p != '&' )
+        return 0;
+    p++;
+    if( strcmp( p, "-" ) == 0 ) {
+        out->kind = REDIR_CLOSE;
+        return 1;
+    }
+    if( !isdigit( (unsigned char) *p ) )
+        return 0;
+    out->kind = REDIR_DUP;
+    out->src_fd = 0;
+    while( isdigit( (unsigned char) *p ) ) {
+        out->src_fd = out->src_fd * 10 + ( *p - '0' );
+        if( out->src_fd > REDIR_MAX_FD )
+            return 0;
+        p++;
+    }
+    if( *p != '\0' )
+        return 0;
+    return 1;
+}
+
+redir_list_t * redir_list_create( void )
+{
+    redir_list_t * new_list = ( redir_list_t * )malloc(sizeof(redir_list_t));
+    new_list->items = NULL;
+    new_list->size = 0;
+    new_list->capacity = 0;
+    return new_list;
+}
+
+void redir_list_delete( redir_list_t * ilist )
+{
+    if( ilist == NULL )
+        return;
+    free( ilist->items );
+    free( ilist );
+}
+
+void redir_list_append( redir_list_t * ilist, const redir_t * r )
+{
+    if( ilist->size == ilist->capacity ) {
+        ilist->capacity = ( ilist->capacity == 0 ) ? 4 : ilist->capacity * 2;
+        ilist->items = ( redir_t * ) realloc( ilist->items,
+                                              ilist->capacity * sizeof( redir_t ) );
+    }
+    ilist->items[ ilist->size ] = *r;
+    ilist->size++;
+}
+
+int redir_list_opens( const redir_list_t * ilist, int fd )
+{
+    int i;
+
+    for( i = 0; i < ilist->size; i++ ) {
+        if( ilist->items[ i ].kind != REDIR_OPEN )
+            continue;
+        if( ilist->items[ i ].fd == fd )
+            return 1;
+        if( ilist->items[ i ].both && fd == STDERR_FILENO )
+            return 1;
+    }
+    return 0;
+}
+
+//Opens r's file, reporting whether this call created it: only new files get
+//the shell's wide-open mode, never an existing file being appended to
+static int open_target( const redir_t * r, int * created )
+{
+    int ofile;
+
+    *created = 0;
+    if( ( r->flags & O_CREAT ) && !( r->flags & O_EXCL ) ) {
+        ofile = open( r->filename, r->flags | O_EXCL, 0777 );
+        if( ofile != -1 || errno != EEXIST ) {
+            *created = ( ofile != -1 );
+            return ofile;
+        }
+        return open( r->filename, r->flags & ~O_CREAT );
+    }
+    ofile = open( r->filename, r->flags, 0777 );
+    *created = ( ofile != -1 && ( r->flags & O_CREAT ) );
+    return ofile;
+}
+
+static int open_onto( const redir_t * r, char * error, size_t error_size )
+{
+    int created;
+    int ofile = open_target( r, &created );
+
+    if( ofile == -1 ) {
+        int err = errno;
+        error[ 0 ] = '\0';
+        childmsg_add( error, error_size, r->filename );
+        childmsg_add( error, error_size, ": " );
+        if( err == EEXIST )
+            childmsg_add( error, error_size, "File exists" );
+        else
+            childmsg_add_errno( error, error_size, err );
+        return -1;
+    }
+    //Newly created output files get the same wide-open mode as before
+    if( created )
+        fchmod( ofile, 0777 );
+
+    if( ofile != r->fd ) {
+        if( dup2( ofile, r->fd ) == -1 ) {
+            int err = errno;
+            error[ 0 ] = '\0';
+            childmsg_add_int( error, error_size, r->fd );
+            childmsg_add( error, error_size, ": " );
+            childmsg_add_errno( error, error_size, err );
+            close( ofile );
+            return -1;
+        }
+        close( ofile );
+    }
+    if( r->both && dup2( r->fd, STDERR_FILENO ) == -1 ) {
+        int err = errno;
+        error[ 0 ] = '\0';
+        childmsg_add( error, error_size, "2: " );
+        childmsg_add_errno( error, error_size, err );
+        return -1;
+    }
+    return 0;
+}
+
+int redir_apply( const redir_list_t * ilist, char * error, size_t error_size )
+{
+    int i;
+
+    if( ilist == NULL )
+        return 0;
+
+    for( i = 0; i < ilist->size; i++ ) {
+        const redir_t * r = &ilist->items[ i ];
+        switch( r->kind ) {
+        case REDIR_OPEN:
+            if( open_onto( r, error, error_size ) == -1 )
+                return -1;
+            break;
+        case REDIR_DUP:
+            if( r->src_fd == r->fd )
+                break;
+            if( dup2( r->src_fd, r->fd ) == -1 ) {
+                error[ 0 ] = '\0';
+                childmsg_add_int( error, error_size, r->src_fd );
+                childmsg_add( error, error_size, ": Bad file descriptor" );
+                return -1;
+            }
+            break;
+        case REDIR_CLOSE:
+            close( r->fd );
+            break;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+#if !defined( __redirect_h )
+#define __redirect_h 1
+
+#include <stddef.h>
+
+typedef enum {
+    REDIR_OPEN,   //n< file, n> file, n>> file, &> file
+    REDIR_DUP,    //n>&m, n<&m
+    REDIR_CLOSE   //n>&-, n<&-
+} redir_kind_t;
+
+typedef struct {
+    redir_kind_t kind;
+    int fd;                //descriptor being redirected
+    int src_fd;            //REDIR_DUP: descriptor copied onto fd
+    int flags;             //REDIR_OPEN: open() flags
+    int both;              //REDIR_OPEN: &> also points stderr at the file
+    const char * filename; //REDIR_OPEN: target file, owned by the caller
+} redir_t;
+
+typedef struct {
+    redir_t * items;
+    int size;
+    int capacity;
+} redir_list_t;
+
+/* redir_parse_operator(): recognizes a redirection token
+ * input: a token from get_chopped_line(); out receives the parsed operator
+ * return value: 0 if the token is not a redirection, 1 if it is complete
+ *   (n>&m, n<&-), 2 if the following token names the file (n>, n>>, n<, &>)
+ */
+int redir_parse_operator( const char * token, redir_t * out );
+
+redir_list_t * redir_list_create( void );
+void redir_list_delete( redir_list_t * ilist );
+void redir_list_append( redir_list_t * ilist, const redir_t * r );
+
+/* redir_list_opens(): reports whether the list opens a file onto fd
+ * return value: 1 if some REDIR_OPEN entry (including &>) targets fd, 0 otherwise
+ */
+int redir_list_opens( const redir_list_t * ilist, int fd );
+
+/* redir_apply(): runs the list as a dup2()/close() sequence, in order
+ * Meant for the child between fork() and exec(). Each file costs one open()
+ * plus a dup2()/close() pair only when it didn't land on its target already.
+ * return value: 0 on success, -1 with a message in error
+ */
+int redir_apply( const redir_list_t * ilist, char * error, size_t error_size );
+
+#endif /* __redirect_h */
@@ -0,0 +1,1197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fnmatch.h>
+
+#include "script.h"
+#include "chop_line.h"
+#include "parse.h"
+
+#define SCRIPT_MAX_CALL_DEPTH 256
+
+typedef enum {
+    OP_RUN,          //a: pipeline; sets the status, or calls a function
+    OP_ASSIGN,       //a: name word, b: value word
+    OP_JUMP,         //a: target
+    OP_JUMP_IF_FAIL, //a: target, taken when the status is not 0
+    OP_JUMP_IF_OK,   //a: target, taken when the status is 0
+    OP_FOR_INIT,     //a: word list, -1 for "$@"; pushes a loop frame
+    OP_FOR_NEXT,     //a: variable word, b: target once the frame is used up
+    OP_FOR_POP,      //drops the innermost loop frame
+    OP_CASE_SUBJECT, //a: word to match against
+    OP_CASE_MATCH,   //a: pattern list, b: target if no pattern matches
+    OP_DEFINE,       //a: name word, b: first instruction after the body
+    OP_RETURN,       //a: status word, -1 to keep the status
+    OP_HALT
+} script_op_t;
+
+typedef struct {
+    unsigned char op;
+    int a;
+    int b;
+} script_insn_t;
+
+typedef struct {
+    int first;  //index into words
+    int count;
+} script_list_t;
+
+typedef struct {
+    chopped_line_t tokens; //owned copies, the template points into them
+    cmd_obj * cmd;
+    int expand;            //some token contains '$'
+} script_pipeline_t;
+
+struct script_program_t {
+    int refs;
+    script_insn_t * code;
+    int code_size, code_capacity;
+    char ** words;
+    int num_words, words_capacity;
+    script_list_t * lists;
+    int num_lists, lists_capacity;
+    script_pipeline_t * pipelines;
+    int num_pipelines, pipelines_capacity;
+};
+
+typedef struct {
+    char * name;
+    script_program_t * prog;
+    int entry;
+} script_function_t;
+
+typedef struct {
+    char * name;
+    char * value;
+} script_var_t;
+
+struct script_state_t {
+    script_var_t * vars;
+    int num_vars, vars_capacity;
+    script_function_t * functions;
+    int num_functions, functions_capacity;
+    char ** args;  //$1..$n of the running function, NULL at top level
+    int num_args;
+    int status;    //$?
+};
+
+
+//Grows *items (of item_size bytes) so that one more element fits
+static void * growArray( void * items, int size, int * capacity, size_t item_size )
+{
+    if( size < *capacity )
+        return items;
+    *capacity = ( *capacity == 0 ) ? 8 : *capacity * 2;
+    return realloc( items, *capacity * item_size );
+}
+
+
+/* ---- state ---- */
+
+script_state_t * script_state_create( void )
+{
+    script_state_t * new_state = ( script_state_t * )calloc( 1, sizeof( script_state_t ) );
+    return new_state;
+}
+
+void script_state_delete( script_state_t * istate )
+{
+    int i;
+    for( i = 0; i < istate->num_vars; i++ ) {
+        free( istate->vars[ i ].name );
+        free( istate->vars[ i ].value );
+    }
+    for( i = 0; i < istate->num_functions; i++ ) {
+        free( istate->functions[ i ].name );
+        script_program_release( istate->functions[ i ].prog );
+    }
+    free( istate->vars );
+    free( istate->functions );
+    free( istate );
+}
+
+static const char * getVar( script_state_t * state, const char * name, size_t len )
+{
+    int i;
+    for( i = 0; i < state->num_vars; i++ ) {
+        if( strncmp( state->vars[ i ].name, name, len ) == 0 && state->vars[ i ].name[ len ] == '\0' )
+            return state->vars[ i ].value;
+    }
+    //Fall back on the environment for $HOME, $PATH and friends
+    char env_name[ 128 ];
+    if( len >= sizeof( env_name ) )
+        return NULL;
+    memcpy( env_name, name, len );
+    env_name[ len ] = '\0';
+    return getenv( env_name );
+}
+
+static void setVar( script_state_t * state, const char * name, char * value )
+{
+    int i;
+    for( i = 0; i < state->num_vars; i++ ) {
+        if( strcmp( state->vars[ i ].name, name ) == 0 ) {
+            free( state->vars[ i ].value );
+            state->vars[ i ].value = value;
+            return;
+        }
+    }
+    state->vars = growArray( state->vars, state->num_vars, &state->vars_capacity, sizeof( script_var_t ) );
+    state->vars[ state->num_vars ].name = strdup( name );
+    state->vars[ state->num_vars ].value = value;
+    state->num_vars++;
+}
+
+static script_function_t * findFunction( script_state_t * state, const char * name )
+{
+    int i;
+    for( i = 0; i < state->num_functions; i++ ) {
+        if( strcmp( state->functions[ i ].name, name ) == 0 )
+            return &state->functions[ i ];
+    }
+    return NULL;
+}
+
+
+/* ---- expansion ---- */
+
+typedef struct {
+    char * data;
+    size_t size, capacity;
+} script_buf_t;
+
+static void bufAppend( script_buf_t * buf, const char * s, size_t len )
+{
+    if( buf->size + len + 1 > buf->capacity ) {
+        while( buf->size + len + 1 > buf->capacity )
+            buf->capacity = ( buf->capacity == 0 ) ? 64 : buf->capacity * 2;
+        buf->data = realloc( buf->data, buf->capacity );
+    }
+    memcpy( buf->data + buf->size, s, len );
+    buf->size += len;
+    buf->data[ buf->size ] = '\0';
+}
+
+static int isNameChar( char c, int first )
+{
+    return c == '_' || isalpha( ( unsigned char )c ) || ( !first && isdigit( ( unsigned char )c ) );
+}
+
+//Replaces $NAME, ${NAME}, $?, $# and $0..$9 in word. Returns a new string
+static char * expandWord( script_state_t * state, const char * word )
+{
+    script_buf_t buf = { NULL, 0, 0 };
+    const char * p = word;
+
+    bufAppend( &buf, "", 0 );
+    while( *p != '\0' ) {
+        const char * dollar = strchr( p, '$' );
+        if( dollar == NULL ) {
+            bufAppend( &buf, p, strlen( p ) );
+            break;
+        }
+        bufAppend( &buf, p, dollar - p );
+        p = dollar + 1;
+
+        char number[ 16 ];
+        const char * value = NULL;
+        if( *p == '?' || *p == '#' ) {
+            snprintf( number, sizeof( number ), "%d", ( *p == '?' ) ? state->status : state->num_args );
+            value = number;
+            p++;
+        }
+        else if( isdigit( ( unsigned char )*p ) ) {
+            int n = *p - '0';
+            value = ( n == 0 ) ? "simsh" : ( n <= state->num_args ) ? state->args[ n - 1 ] : NULL;
+            p++;
+        }
+        else if( *p == '{' && isNameChar( p[ 1 ], 1 ) && strchr( p, '}' ) != NULL ) {
+            const char * end = strchr( p, '}' );
+            value = getVar( state, p + 1, end - p - 1 );
+            p = end + 1;
+        }
+        else if( isNameChar( *p, 1 ) ) {
+            const char * end = p;
+            while( isNameChar( *end, 0 ) )
+                end++;
+            value = getVar( state, p, end - p );
+            p = end;
+        }
+        else {
+            //A lone '$' stays as it is
+            bufAppend( &buf, "$", 1 );
+            continue;
+        }
+        if( value != NULL )
+            bufAppend( &buf, value, strlen( value ) );
+    }
+    return buf.data;
+}
+
+//Expands word and splits the result on whitespace, appending each field
+//to *fields. Words without '$' are taken as they are
+static void expandFields( script_state_t * state, const char * word, char *** fields, int * num_fields, int * capacity )
+{
+    if( strchr( word, '$' ) == NULL ) {
+        *fields = growArray( *fields, *num_fields, capacity, sizeof( char * ) );
+        ( *fields )[ ( *num_fields )++ ] = strdup( word );
+        return;
+    }
+    char * expanded = expandWord( state, word );
+    char * save = NULL;
+    char * field;
+    for( field = strtok_r( expanded, " \t\n", &save ); field != NULL; field = strtok_r( NULL, " \t\n", &save ) ) {
+        *fields = growArray( *fields, *num_fields, capacity, sizeof( char * ) );
+        ( *fields )[ ( *num_fields )++ ] = strdup( field );
+    }
+    free( expanded );
+}
+
+static void freeFields( char ** fields, int num_fields )
+{
+    int i;
+    for( i = 0; i < num_fields; i++ )
+        free( fields[ i ] );
+    free( fields );
+}
+
+//Builds a copy of a pipeline template with its words expanded. Every string
+//the copy allocates is listed in *strings so freeExpanded() can drop them
+static cmd_obj * expandPipeline( script_state_t * state, const cmd_obj * templ, char *** strings, int * num_strings )
+{
+    cmd_obj * head = NULL;
+    cmd_obj ** tail = &head;
+    int capacity = 0;
+
+    *strings = NULL;
+    *num_strings = 0;
+    for( ; templ != NULL; templ = templ->next_cmd ) {
+        cmd_obj * stage = ( cmd_obj * )malloc( sizeof( cmd_obj ) );
+        int first = *num_strings;
+        int i;
+
+        *stage = *templ;
+        stage->next_cmd = NULL;
+        for( i = 0; templ->argv[ i ] != NULL; i++ )
+            expandFields( state, templ->argv[ i ], strings, num_strings, &capacity );
+        stage->argv = ( char ** )malloc( ( *num_strings - first + 1 ) * sizeof( char * ) );
+        for( i = first; i < *num_strings; i++ )
+            stage->argv[ i - first ] = ( *strings )[ i ];
+        stage->argv[ *num_strings - first ] = NULL;
+
+#if SIMSH_MAX_LEVEL >= 2
+        if( templ->redirs != NULL ) {
+            stage->redirs = redir_list_create();
+            for( i = 0; i < templ->redirs->size; i++ ) {
+                redir_t r = templ->redirs->items[ i ];
+                if( r.kind == REDIR_OPEN && strchr( r.filename, '$' ) != NULL ) {
+                    char * filename = expandWord( state, r.filename );
+                    *strings = growArray( *strings, *num_strings, &capacity, sizeof( char * ) );
+                    ( *strings )[ ( *num_strings )++ ] = filename;
+                    r.filename = filename;
+                }
+                redir_list_append( stage->redirs, &r );
+            }
+        }
+#endif
+        *tail = stage;
+        tail = &stage->next_cmd;
+    }
+    return head;
+}
+
+static void freeExpanded( cmd_obj * cmd, char ** strings, int num_strings )
+{
+    while( cmd != NULL ) {
+        cmd_obj * next = cmd->next_cmd;
+        free( cmd->argv );
+#if SIMSH_MAX_LEVEL >= 2
+        if( cmd->redirs != NULL )
+            redir_list_delete( cmd->redirs );
+#endif
+        free( cmd );
+        cmd = next;
+    }
+    freeFields( strings, num_strings );
+}
+
+
+/* ---- compiler ---- */
+
+typedef enum {
+    TOK_WORD,
+    TOK_SEP,    //; or newline
+    TOK_DSEMI,  //;;
+    TOK_EOF
+} script_tok_type_t;
+
+typedef struct {
+    script_tok_type_t type;
+    char * text;
+} script_token_t;
+
+typedef struct {
+    int continue_target;
+    int * breaks;        //jumps to patch with the loop's end
+    int num_breaks, breaks_capacity;
+} script_loop_t;
+
+typedef struct {
+    script_token_t * tokens;
+    int num_tokens, tokens_capacity;
+    int pos;
+    script_program_t * prog;
+    int features;
+    script_loop_t * loops;
+    int num_loops, loops_capacity;
+    int in_function;
+    char * error;
+    size_t error_size;
+    int incomplete;
+} script_compiler_t;
+
+//find's -exec and -ok options run up to a lone ";" argument
+static int opensExec( const char * word )
+{
+    return strcmp( word, "-exec" ) == 0 || strcmp( word, "-execdir" ) == 0
+        || strcmp( word, "-ok" ) == 0 || strcmp( word, "-okdir" ) == 0;
+}
+
+static void lexText( script_compiler_t * c, const char * text )
+{
+    const char * p = text;
+    int in_exec = 0;
+    while( 1 ) {
+        script_token_t tok = { TOK_EOF, NULL };
+        while( *p == ' ' || *p == '\t' || *p == '\r' )
+            p++;
+        if( *p == '#' ) {
+            while( *p != '\0' && *p != '\n' )
+                p++;
+        }
+        if( *p == '\0' ) {
+            tok.type = TOK_EOF;
+        }
+        else if( *p == ';' && in_exec && ( p[ 1 ] == '\0' || isspace( ( unsigned char )p[ 1 ] ) ) ) {
+            //"find . -exec rm {} ;" passes the ; on to find
+            tok.type = TOK_WORD;
+            tok.text = strdup( ";" );
+            in_exec = 0;
+            p++;
+        }
+        else if( *p == '\n' || ( *p == ';' && p[ 1 ] != ';' ) ) {
+            tok.type = TOK_SEP;
+            p++;
+        }
+        else if( *p == ';' ) {
+            tok.type = TOK_DSEMI;
+            p += 2;
+        }
+        else {
+            //\; is a ; that belongs to the word
+            const char * start = p;
+            size_t len = 0;
+            while( *p != '\0' && !isspace( ( unsigned char )*p ) && *p != ';' ) {
+                if( *p == '\\' && p[ 1 ] == ';' )
+                    p++;
+                p++;
+            }
+            tok.type = TOK_WORD;
+            tok.text = ( char * )malloc( p - start + 1 );
+            while( start < p ) {
+                if( *start == '\\' && start[ 1 ] == ';' )
+                    start++;
+                tok.text[ len++ ] = *start++;
+            }
+            tok.text[ len ] = '\0';
+            if( opensExec( tok.text ) )
+                in_exec = 1;
+            else if( strcmp( tok.text, ";" ) == 0 )
+                in_exec = 0;
+        }
+        if( tok.type == TOK_SEP || tok.type == TOK_DSEMI )
+            in_exec = 0;
+        c->tokens = growArray( c->tokens, c->num_tokens, &c->tokens_capacity, sizeof( script_token_t ) );
+        c->tokens[ c->num_tokens++ ] = tok;
+        if( tok.type == TOK_EOF )
+            break;
+    }
+}
+
+static script_token_t * peek( script_compiler_t * c )
+{
+    return &c->tokens[ c->pos ];
+}
+
+static int peekWord( script_compiler_t * c, const char * word )
+{
+    script_token_t * tok = peek( c );
+    return tok->type == TOK_WORD && strcmp( tok->text, word ) == 0;
+}
+
+static void skipSeparators( script_compiler_t * c )
+{
+    while( peek( c )->type == TOK_SEP )
+        c->pos++;
+}
+
+static int compileError( script_compiler_t * c, const char * message )
+{
+    if( peek( c )->type == TOK_EOF ) {
+        c->incomplete = 1;
+        snprintf( c->error, c->error_size, "Unexpected end of script" );
+    }
+    else {
+        snprintf( c->error, c->error_size, "%s", message );
+    }
+    return -1;
+}
+
+//Consumes the keyword word or fails
+static int expect( script_compiler_t * c, const char * word )
+{
+    char message[ 64 ];
+    if( peekWord( c, word ) ) {
+        c->pos++;
+        return 0;
+    }
+    snprintf( message, sizeof( message ), "Expected '%s'", word );
+    return compileError( c, message );
+}
+
+static int emit( script_compiler_t * c, script_op_t op, int a, int b )
+{
+    script_program_t * prog = c->prog;
+    prog->code = growArray( prog->code, prog->code_size, &prog->code_capacity, sizeof( script_insn_t ) );
+    prog->code[ prog->code_size ].op = op;
+    prog->code[ prog->code_size ].a = a;
+    prog->code[ prog->code_size ].b = b;
+    return prog->code_size++;
+}
+
+static int addWord( script_compiler_t * c, const char * word )
+{
+    script_program_t * prog = c->prog;
+    prog->words = growArray( prog->words, prog->num_words, &prog->words_capacity, sizeof( char * ) );
+    prog->words[ prog->num_words ] = strdup( word );
+    return prog->num_words++;
+}
+
+static int addList( script_compiler_t * c, int first, int count )
+{
+    script_program_t * prog = c->prog;
+    prog->lists = growArray( prog->lists, prog->num_lists, &prog->lists_capacity, sizeof( script_list_t ) );
+    prog->lists[ prog->num_lists ].first = first;
+    prog->lists[ prog->num_lists ].count = count;
+    return prog->num_lists++;
+}
+
+static int here( script_compiler_t * c )
+{
+    return c->prog->code_size;
+}
+
+//Points the jump at insn to the current end of the code
+static void patch( script_compiler_t * c, int insn )
+{
+    if( c->prog->code[ insn ].op == OP_FOR_NEXT || c->prog->code[ insn ].op == OP_CASE_MATCH
+        || c->prog->code[ insn ].op == OP_DEFINE )
+        c->prog->code[ insn ].b = here( c );
+    else
+        c->prog->code[ insn ].a = here( c );
+}
+
+static const char * const reserved_words[] = {
+    "then", "elif", "else", "fi", "do", "done", "esac", "}", NULL
+};
+
+static int compileList( script_compiler_t * c );
+
+//Keywords that end a list when they start a command
+static int atListEnd( script_compiler_t * c )
+{
+    script_token_t * tok = peek( c );
+    int i;
+    if( tok->type == TOK_EOF || tok->type == TOK_DSEMI )
+        return 1;
+    for( i = 0; reserved_words[ i ] != NULL; i++ ) {
+        if( tok->type == TOK_WORD && strcmp( tok->text, reserved_words[ i ] ) == 0 )
+            return 1;
+    }
+    return 0;
+}
+
+static int isAssignment( const char * word )
+{
+    const char * p = word;
+    if( !isNameChar( *p, 1 ) )
+        return 0;
+    while( isNameChar( *p, 0 ) )
+        p++;
+    return *p == '=';
+}
+
+static int compileSimple( script_compiler_t * c )
+{
+    script_program_t * prog = c->prog;
+    int start = c->pos;
+    int count;
+    int i;
+
+    while( peek( c )->type == TOK_WORD )
+        c->pos++;
+    count = c->pos - start;
+
+    //NAME=value on its own sets a variable
+    if( count == 1 && isAssignment( c->tokens[ start ].text ) ) {
+        char * eq = strchr( c->tokens[ start ].text, '=' );
+        *eq = '\0';
+        int name = addWord( c, c->tokens[ start ].text );
+        int value = addWord( c, eq + 1 );
+        *eq = '=';
+        emit( c, OP_ASSIGN, name, value );
+        return 0;
+    }
+
+    script_pipeline_t pipeline;
+    memset( &pipeline, 0, sizeof( pipeline ) );
+    pipeline.tokens.tokens = ( char ** )malloc( ( count + 1 ) * sizeof( char * ) );
+    pipeline.tokens.num_tokens = count;
+    for( i = 0; i < count; i++ ) {
+        pipeline.tokens.tokens[ i ] = strdup( c->tokens[ start + i ].text );
+        if( strchr( pipeline.tokens.tokens[ i ], '$' ) != NULL )
+            pipeline.expand = 1;
+    }
+    pipeline.tokens.tokens[ count ] = NULL;
+    pipeline.cmd = processCmd( &pipeline.tokens, c->features, c->error, c->error_size );
+    if( pipeline.cmd == NULL ) {
+        freeFields( pipeline.tokens.tokens, count );
+        return -1;
+    }
+    prog->pipelines = growArray( prog->pipelines, prog->num_pipelines, &prog->pipelines_capacity, sizeof( script_pipeline_t ) );
+    prog->pipelines[ prog->num_pipelines ] = pipeline;
+    emit( c, OP_RUN, prog->num_pipelines++, 0 );
+    return 0;
+}
+
+//Jumps to the end of an if or case, patched once the end is known
+typedef struct {
+    int * jumps;
+    int num_jumps, jumps_capacity;
+} script_ends_t;
+
+static void addEnd( script_compiler_t * c, script_ends_t * ends )
+{
+    ends->jumps = growArray( ends->jumps, ends->num_jumps, &ends->jumps_capacity, sizeof( int ) );
+    ends->jumps[ ends->num_jumps++ ] = emit( c, OP_JUMP, -1, 0 );
+}
+
+//Points every jump here (unless compiling failed) and frees the list
+static int patchEnds( script_compiler_t * c, script_ends_t * ends, int ret )
+{
+    int i;
+    if( ret == 0 ) {
+        for( i = 0; i < ends->num_jumps; i++ )
+            patch( c, ends->jumps[ i ] );
+    }
+    free( ends->jumps );
+    return ret;
+}
+
+static int compileIf( script_compiler_t * c )
+{
+    script_ends_t ends = { NULL, 0, 0 };
+
+    c->pos++;
+    while( 1 ) {
+        if( compileList( c ) != 0 || expect( c, "then" ) != 0 )
+            return patchEnds( c, &ends, -1 );
+        int skip = emit( c, OP_JUMP_IF_FAIL, -1, 0 );
+        if( compileList( c ) != 0 )
+            return patchEnds( c, &ends, -1 );
+        addEnd( c, &ends );
+        patch( c, skip );
+        if( peekWord( c, "elif" ) ) {
+            c->pos++;
+            continue;
+        }
+        if( peekWord( c, "else" ) ) {
+            c->pos++;
+            if( compileList( c ) != 0 )
+                return patchEnds( c, &ends, -1 );
+        }
+        if( expect( c, "fi" ) != 0 )
+            return patchEnds( c, &ends, -1 );
+        break;
+    }
+    return patchEnds( c, &ends, 0 );
+}
+
+static void pushLoop( script_compiler_t * c, int continue_target )
+{
+    c->loops = growArray( c->loops, c->num_loops, &c->loops_capacity, sizeof( script_loop_t ) );
+    memset( &c->loops[ c->num_loops ], 0, sizeof( script_loop_t ) );
+    c->loops[ c->num_loops ].continue_target = continue_target;
+    c->num_loops++;
+}
+
+//Points every break of the innermost loop here and drops it
+static void popLoop( script_compiler_t * c )
+{
+    script_loop_t * loop = &c->loops[ --c->num_loops ];
+    int i;
+    for( i = 0; i < loop->num_breaks; i++ )
+        patch( c, loop->breaks[ i ] );
+    free( loop->breaks );
+}
+
+static int compileBody( script_compiler_t * c )
+{
+    skipSeparators( c );
+    if( expect( c, "do" ) != 0 || compileList( c ) != 0 || expect( c, "done" ) != 0 )
+        return -1;
+    return 0;
+}
+
+//while/until LIST do LIST done
+static int compileWhile( script_compiler_t * c )
+{
+    int until = peekWord( c, "until" );
+    int top = here( c );
+
+    c->pos++;
+    if( compileList( c ) != 0 )
+        return -1;
+    int exit_jump = emit( c, until ? OP_JUMP_IF_OK : OP_JUMP_IF_FAIL, -1, 0 );
+    pushLoop( c, top );
+    int ret = compileBody( c );
+    emit( c, OP_JUMP, top, 0 );
+    patch( c, exit_jump );
+    popLoop( c );
+    return ret;
+}
+
+//for NAME [in WORDS] do LIST done
+static int compileFor( script_compiler_t * c )
+{
+    int list = -1;
+
+    c->pos++;
+    if( peek( c )->type != TOK_WORD || !isNameChar( peek( c )->text[ 0 ], 1 ) )
+        return compileError( c, "Expected a variable name after 'for'" );
+    int name = addWord( c, peek( c )->text );
+    c->pos++;
+    if( peekWord( c, "in" ) ) {
+        int first = c->prog->num_words;
+        c->pos++;
+        while( peek( c )->type == TOK_WORD ) {
+            addWord( c, peek( c )->text );
+            c->pos++;
+        }
+        list = addList( c, first, c->prog->num_words - first );
+    }
+    emit( c, OP_FOR_INIT, list, 0 );
+    int next = emit( c, OP_FOR_NEXT, name, -1 );
+    pushLoop( c, next );
+    int ret = compileBody( c );
+    emit( c, OP_JUMP, next, 0 );
+    patch( c, next );
+    popLoop( c );
+    emit( c, OP_FOR_POP, 0, 0 );
+    return ret;
+}
+
+//case WORD in [(]PAT[|PAT]...) LIST ;; ... esac
+static int compileCase( script_compiler_t * c )
+{
+    script_ends_t ends = { NULL, 0, 0 };
+
+    c->pos++;
+    if( peek( c )->type != TOK_WORD )
+        return compileError( c, "Expected a word after 'case'" );
+    emit( c, OP_CASE_SUBJECT, addWord( c, peek( c )->text ), 0 );
+    c->pos++;
+    if( expect( c, "in" ) != 0 )
+        return -1;
+    while( 1 ) {
+        skipSeparators( c );
+        if( peekWord( c, "esac" ) )
+            break;
+
+        //Gather the pattern words up to the one ending in ')'
+        script_buf_t patterns = { NULL, 0, 0 };
+        int closed = 0;
+        bufAppend( &patterns, "", 0 );
+        while( !closed && peek( c )->type == TOK_WORD ) {
+            const char * text = peek( c )->text;
+            size_t len = strlen( text );
+            if( patterns.size == 0 && text[ 0 ] == '(' ) {
+                text++;
+                len--;
+            }
+            if( len > 0 && text[ len - 1 ] == ')' ) {
+                closed = 1;
+                len--;
+            }
+            bufAppend( &patterns, text, len );
+            c->pos++;
+        }
+        if( !closed || patterns.size == 0 ) {
+            free( patterns.data );
+            return patchEnds( c, &ends, compileError( c, "Expected a pattern ending in ')'" ) );
+        }
+        int first = c->prog->num_words;
+        char * save = NULL;
+        char * pattern;
+        for( pattern = strtok_r( patterns.data, "|", &save ); pattern != NULL; pattern = strtok_r( NULL, "|", &save ) )
+            addWord( c, pattern );
+        free( patterns.data );
+
+        int match = emit( c, OP_CASE_MATCH, addList( c, first, c->prog->num_words - first ), -1 );
+        if( compileList( c ) != 0 )
+            return patchEnds( c, &ends, -1 );
+        addEnd( c, &ends );
+        patch( c, match );
+        if( peek( c )->type == TOK_DSEMI )
+            c->pos++;
+        else if( !peekWord( c, "esac" ) )
+            return patchEnds( c, &ends, compileError( c, "Expected ';;' or 'esac'" ) );
+    }
+    c->pos++;
+    return patchEnds( c, &ends, 0 );
+}
+
+//NAME() { LIST }, NAME () { LIST } or function NAME { LIST }
+static int compileFunction( script_compiler_t * c )
+{
+    char name[ 128 ];
+    const char * text;
+
+    if( peekWord( c, "function" ) )
+        c->pos++;
+    if( peek( c )->type != TOK_WORD )
+        return compileError( c, "Expected a function name" );
+    text = peek( c )->text;
+    snprintf( name, sizeof( name ), "%.*s", ( int )strcspn( text, "(" ), text );
+    c->pos++;
+    if( peekWord( c, "()" ) )
+        c->pos++;
+    if( name[ 0 ] == '\0' )
+        return compileError( c, "Expected a function name" );
+    skipSeparators( c );
+    if( expect( c, "{" ) != 0 )
+        return -1;
+
+    int define = emit( c, OP_DEFINE, addWord( c, name ), -1 );
+
+    //break and continue don't reach loops outside the body
+    int saved_loops = c->num_loops;
+    c->num_loops = 0;
+    c->in_function++;
+    int ret = compileList( c );
+    c->in_function--;
+    c->num_loops = saved_loops;
+    if( ret != 0 || expect( c, "}" ) != 0 )
+        return -1;
+    emit( c, OP_RETURN, -1, 0 );
+    patch( c, define );
+    return 0;
+}
+
+static int compileCommand( script_compiler_t * c )
+{
+    script_token_t * tok = peek( c );
+    const char * word = tok->text;
+
+    if( strcmp( word, "if" ) == 0 )
+        return compileIf( c );
+    if( strcmp( word, "while" ) == 0 || strcmp( word, "until" ) == 0 )
+        return compileWhile( c );
+    if( strcmp( word, "for" ) == 0 )
+        return compileFor( c );
+    if( strcmp( word, "case" ) == 0 )
+        return compileCase( c );
+    if( strcmp( word, "function" ) == 0 || ( strlen( word ) > 2 && strcmp( word + strlen( word ) - 2, "()" ) == 0 )
+        || ( tok[ 1 ].type == TOK_WORD && strcmp( tok[ 1 ].text, "()" ) == 0 ) )
+        return compileFunction( c );
+    if( strcmp( word, "break" ) == 0 || strcmp( word, "continue" ) == 0 ) {
+        if( c->num_loops == 0 ) {
+            snprintf( c->error, c->error_size, "%s: only meaningful in a loop", word );
+            return -1;
+        }
+        script_loop_t * loop = &c->loops[ c->num_loops - 1 ];
+        c->pos++;
+        if( word[ 0 ] == 'c' ) {
+            emit( c, OP_JUMP, loop->continue_target, 0 );
+        }
+        else {
+            loop->breaks = growArray( loop->breaks, loop->num_breaks, &loop->breaks_capacity, sizeof( int ) );
+            loop->breaks[ loop->num_breaks++ ] = emit( c, OP_JUMP, -1, 0 );
+        }
+        return 0;
+    }
+    if( strcmp( word, "return" ) == 0 ) {
+        int status = -1;
+        if( c->in_function == 0 ) {
+            snprintf( c->error, c->error_size, "return: only meaningful in a function" );
+            return -1;
+        }
+        c->pos++;
+        if( peek( c )->type == TOK_WORD ) {
+            status = addWord( c, peek( c )->text );
+            c->pos++;
+        }
+        emit( c, OP_RETURN, status, 0 );
+        return 0;
+    }
+    return compileSimple( c );
+}
+
+//Commands up to a reserved word, ';;' or the end of the text
+static int compileList( script_compiler_t * c )
+{
+    while( 1 ) {
+        skipSeparators( c );
+        if( atListEnd( c ) )
+            return 0;
+        if( compileCommand( c ) != 0 )
+            return -1;
+        if( peek( c )->type == TOK_WORD ) {
+            snprintf( c->error, c->error_size, "Unexpected '%s'", peek( c )->text );
+            return -1;
+        }
+    }
+}
+
+int script_compile( const char * text, int features, script_program_t ** out,
+                    char * error, size_t error_size )
+{
+    script_compiler_t c;
+    int ret = 0;
+    int i;
+
+    memset( &c, 0, sizeof( c ) );
+    c.prog = ( script_program_t * )calloc( 1, sizeof( script_program_t ) );
+    c.prog->refs = 1;
+    c.features = features;
+    c.error = error;
+    c.error_size = error_size;
+    lexText( &c, text );
+
+    if( compileList( &c ) != 0 ) {
+        ret = c.incomplete ? SCRIPT_INCOMPLETE : -1;
+    }
+    else if( peek( &c )->type != TOK_EOF ) {
+        snprintf( error, error_size, "Unexpected '%s'",
+                  peek( &c )->type == TOK_DSEMI ? ";;" : peek( &c )->text );
+        ret = -1;
+    }
+    emit( &c, OP_HALT, 0, 0 );
+
+    for( i = 0; i < c.num_tokens; i++ )
+        free( c.tokens[ i ].text );
+    free( c.tokens );
+    for( i = 0; i < c.num_loops; i++ )
+        free( c.loops[ i ].breaks );
+    free( c.loops );
+
+    if( ret != 0 ) {
+        script_program_release( c.prog );
+        *out = NULL;
+        return ret;
+    }
+    *out = c.prog;
+    return 0;
+}
+
+void script_program_release( script_program_t * iprog )
+{
+    int i;
+    if( iprog == NULL || --iprog->refs > 0 )
+        return;
+    for( i = 0; i < iprog->num_pipelines; i++ ) {
+        freeCmd( iprog->pipelines[ i ].cmd );
+        freeFields( iprog->pipelines[ i ].tokens.tokens, iprog->pipelines[ i ].tokens.num_tokens );
+    }
+    freeFields( iprog->words, iprog->num_words );
+    free( iprog->pipelines );
+    free( iprog->lists );
+    free( iprog->code );
+    free( iprog );
+}
+
+
+/* ---- virtual machine ---- */
+
+typedef struct {
+    char ** items;
+    int count;
+    int next;
+} script_for_t;
+
+typedef struct {
+    script_program_t * prog;
+    int return_pc;
+    char ** args;
+    int num_args;
+    int for_depth;
+} script_frame_t;
+
+typedef struct {
+    script_for_t * fors;
+    int num_fors, fors_capacity;
+    script_frame_t * frames;
+    int num_frames, frames_capacity;
+    char * case_subject;
+} script_vm_t;
+
+static void popFor( script_vm_t * vm )
+{
+    script_for_t * loop = &vm->fors[ --vm->num_fors ];
+    freeFields( loop->items, loop->count );
+}
+
+//Enters function f with argv[1..] as its positional parameters
+static void callFunction( script_vm_t * vm, script_state_t * state, script_function_t * f,
+                          script_program_t ** prog, int * pc, char ** argv )
+{
+    script_frame_t frame;
+    int n = 0;
+
+    frame.prog = *prog;
+    frame.return_pc = *pc;
+    frame.args = state->args;
+    frame.num_args = state->num_args;
+    frame.for_depth = vm->num_fors;
+    vm->frames = growArray( vm->frames, vm->num_frames, &vm->frames_capacity, sizeof( script_frame_t ) );
+    vm->frames[ vm->num_frames++ ] = frame;
+
+    while( argv[ n + 1 ] != NULL )
+        n++;
+    state->args = ( char ** )malloc( ( n + 1 ) * sizeof( char * ) );
+    state->num_args = n;
+    for( n = 0; n < state->num_args; n++ )
+        state->args[ n ] = strdup( argv[ n + 1 ] );
+    //Redefining f while its body runs must not free the code under us
+    f->prog->refs++;
+    *prog = f->prog;
+    *pc = f->entry;
+}
+
+//Leaves the innermost function; returns 0 once the call stack is empty
+static int returnFromFunction( script_vm_t * vm, script_state_t * state, script_program_t ** prog, int * pc )
+{
+    if( vm->num_frames == 0 )
+        return 0;
+    script_frame_t * frame = &vm->frames[ --vm->num_frames ];
+    while( vm->num_fors > frame->for_depth )
+        popFor( vm );
+    freeFields( state->args, state->num_args );
+    state->args = frame->args;
+    state->num_args = frame->num_args;
+    script_program_release( *prog );
+    *prog = frame->prog;
+    *pc = frame->return_pc;
+    return 1;
+}
+
+static int runPipeline( script_vm_t * vm, script_state_t * state, simsh_ctx_t * ctx,
+                        script_program_t ** prog, int * pc, int index, simsh_result_t * result )
+{
+    script_pipeline_t * pipeline = &( *prog )->pipelines[ index ];
+    cmd_obj * cmd = pipeline->cmd;
+    char ** strings = NULL;
+    int num_strings = 0;
+    int ret = 0;
+
+    if( pipeline->expand ) {
+        cmd_obj * stage;
+        cmd = expandPipeline( state, pipeline->cmd, &strings, &num_strings );
+        //A word that expanded to nothing leaves nothing to run, but a
+        //pipeline cannot have an empty stage
+        for( stage = cmd; stage != NULL; stage = stage->next_cmd ) {
+            if( stage->argv[ 0 ] != NULL )
+                continue;
+            if( cmd->next_cmd == NULL ) {
+                state->status = 0;
+            }
+            else {
+                snprintf( result->error, SIMSH_ERROR_SIZE, "Invalid null command" );
+                state->status = 1;
+            }
+            freeExpanded( cmd, strings, num_strings );
+            return 0;
+        }
+    }
+
+    script_function_t * f = NULL;
+    if( cmd->next_cmd == NULL && !cmd->is_background )
+        f = findFunction( state, cmd->argv[ 0 ] );
+    if( f != NULL ) {
+        //A function runs in the shell itself: redirecting it would move the
+        //descriptors of every thread in the host, and there is no child to
+        //put limits on
+        if( ( cmd->redirs != NULL && cmd->redirs->size > 0 ) || limits_any_set( &cmd->limits ) ) {
+            snprintf( result->error, SIMSH_ERROR_SIZE, "%s: redirections and run limits do not apply to functions",
+                      cmd->argv[ 0 ] );
+            ret = -1;
+        }
+        else if( vm->num_frames >= SCRIPT_MAX_CALL_DEPTH ) {
+            snprintf( result->error, SIMSH_ERROR_SIZE, "%s: maximum function nesting exceeded", cmd->argv[ 0 ] );
+            ret = -1;
+        }
+        else {
+            callFunction( vm, state, f, prog, pc, cmd->argv );
+        }
+    }
+    else {
+        simsh_result_t previous = *result;
+        memset( result, 0, sizeof( simsh_result_t ) );
+        ret = simsh_exec_pipeline( ctx, cmd, result );
+        result->exit_requested |= previous.exit_requested;
+        //The result describes the last pipeline; an earlier one's stats go
+        //to the context's callback, and its warning is kept unless replaced
+        if( previous.has_stats )
+            simsh_report_stats( ctx, &previous.stats );
+        if( result->warning[ 0 ] == '\0' )
+            memcpy( result->warning, previous.warning, SIMSH_ERROR_SIZE );
+        state->status = ( ret == 0 ) ? result->status : 1;
+        //A failed pipe() only loses this command, not the rest of the
+        //script; the last such error is what the caller sees
+        if( ret == 0 && result->error[ 0 ] == '\0' )
+            memcpy( result->error, previous.error, SIMSH_ERROR_SIZE );
+        ret = 0;
+    }
+    if( pipeline->expand )
+        freeExpanded( cmd, strings, num_strings );
+    return ret;
+}
+
+int script_run( script_program_t * iprog, script_state_t * istate,
+                simsh_ctx_t * ictx, simsh_result_t * result )
+{
+    script_vm_t vm;
+    script_program_t * prog = iprog;
+    int pc = 0;
+    int ret = 0;
+
+    memset( &vm, 0, sizeof( vm ) );
+    memset( result, 0, sizeof( simsh_result_t ) );
+    while( ret == 0 && !result->exit_requested ) {
+        script_insn_t * insn = &prog->code[ pc++ ];
+        script_list_t * list;
+        char * value;
+        int i;
+
+        switch( insn->op ) {
+        case OP_RUN:
+            ret = runPipeline( &vm, istate, ictx, &prog, &pc, insn->a, result );
+            break;
+        case OP_ASSIGN:
+            setVar( istate, prog->words[ insn->a ], expandWord( istate, prog->words[ insn->b ] ) );
+            istate->status = 0;
+            break;
+        case OP_JUMP:
+            pc = insn->a;
+            break;
+        case OP_JUMP_IF_FAIL:
+            if( istate->status != 0 )
+                pc = insn->a;
+            break;
+        case OP_JUMP_IF_OK:
+            if( istate->status == 0 )
+                pc = insn->a;
+            break;
+        case OP_FOR_INIT: {
+            script_for_t loop = { NULL, 0, 0 };
+            int capacity = 0;
+            if( insn->a == -1 ) {
+                for( i = 0; i < istate->num_args; i++ )
+                    expandFields( istate, istate->args[ i ], &loop.items, &loop.count, &capacity );
+            }
+            else {
+                list = &prog->lists[ insn->a ];
+                for( i = 0; i < list->count; i++ )
+                    expandFields( istate, prog->words[ list->first + i ], &loop.items, &loop.count, &capacity );
+            }
+            vm.fors = growArray( vm.fors, vm.num_fors, &vm.fors_capacity, sizeof( script_for_t ) );
+            vm.fors[ vm.num_fors++ ] = loop;
+            istate->status = 0;
+            break;
+        }
+        case OP_FOR_NEXT: {
+            script_for_t * loop = &vm.fors[ vm.num_fors - 1 ];
+            if( loop->next == loop->count )
+                pc = insn->b;
+            else
+                setVar( istate, prog->words[ insn->a ], strdup( loop->items[ loop->next++ ] ) );
+            break;
+        }
+        case OP_FOR_POP:
+            popFor( &vm );
+            break;
+        case OP_CASE_SUBJECT:
+            free( vm.case_subject );
+            vm.case_subject = expandWord( istate, prog->words[ insn->a ] );
+            istate->status = 0;
+            break;
+        case OP_CASE_MATCH:
+            list = &prog->lists[ insn->a ];
+            for( i = 0; i < list->count; i++ ) {
+                value = expandWord( istate, prog->words[ list->first + i ] );
+                int matched = fnmatch( value, vm.case_subject, 0 ) == 0;
+                free( value );
+                if( matched )
+                    break;
+            }
+            if( i == list->count )
+                pc = insn->b;
+            break;
+        case OP_DEFINE: {
+            script_function_t * f = findFunction( istate, prog->words[ insn->a ] );
+            if( f == NULL ) {
+                istate->functions = growArray( istate->functions, istate->num_functions,
+                                               &istate->functions_capacity, sizeof( script_function_t ) );
+                f = &istate->functions[ istate->num_functions++ ];
+                f->name = strdup( prog->words[ insn->a ] );
+                f->prog = NULL;
+            }
+            //The body stays in this program, which now lives as long as the function
+            prog->refs++;
+            if( f->prog != NULL )
+                script_program_release( f->prog );
+            f->prog = prog;
+            f->entry = pc;
+            pc = insn->b;
+            istate->status = 0;
+            break;
+        }
+        case OP_RETURN:
+            if( insn->a != -1 ) {
+                value = expandWord( istate, prog->words[ insn->a ] );
+                istate->status = atoi( value ) & 0xff;
+                free( value );
+            }
+            if( !returnFromFunction( &vm, istate, &prog, &pc ) )
+                goto done;
+            break;
+        case OP_HALT:
+            if( !returnFromFunction( &vm, istate, &prog, &pc ) )
+                goto done;
+            break;
+        }
+    }
+done:
+    //exit or an error can leave functions and loops open
+    while( returnFromFunction( &vm, istate, &prog, &pc ) )
+        ;
+    while( vm.num_fors > 0 )
+        popFor( &vm );
+    free( vm.fors );
+    free( vm.frames );
+    free( vm.case_subject );
+    if( ret == 0 )
+        result->status = istate->status;
+    return ret;
+}
@@ -0,0 +1,57 @@
+#if !defined( __script_h )
+#define __script_h 1
+
+#include <stddef.h>
+
+#include "simsh.h"
+#include "parse.h"
+
+/* Control flow for libsimsh: if/elif/else/fi, while/until ... do ... done,
+ * for NAME in WORDS ... do ... done, case WORD in PAT|PAT) ... ;; esac,
+ * NAME() { ... } functions with $1..$9/$#, break, continue, return, NAME=value
+ * and $NAME / ${NAME} / $? expansion.
+ *
+ * Text is compiled once into a script_program_t: a flat array of
+ * instructions whose simple commands point at pipelines already run through
+ * processCmd(). Running a loop only re-expands the words that contain '$';
+ * nothing is tokenized or parsed again.
+ */
+
+typedef struct script_program_t script_program_t;
+
+/* Variables, functions and the programs that define them; one per context */
+typedef struct script_state_t script_state_t;
+
+#define SCRIPT_INCOMPLETE -2
+
+script_state_t * script_state_create( void );
+void script_state_delete( script_state_t * istate );
+
+/* script_compile(): compiles script text
+ * input: features is the PARSE_* mask used for every simple command
+ * return value: 0 on success with the program in *out, -1 with a message in
+ *   error, or SCRIPT_INCOMPLETE if the text ends inside an unfinished block
+ */
+int script_compile( const char * text, int features, script_program_t ** out,
+                    char * error, size_t error_size );
+
+/* script_run(): runs a compiled program in ctx
+ * Functions it defines stay in istate, so the program is kept alive by it
+ * if needed; always call script_program_release() afterwards.
+ * return value: 0 on success, -1 with a message in result->error
+ */
+int script_run( script_program_t * iprog, script_state_t * istate,
+                simsh_ctx_t * ictx, simsh_result_t * result );
+
+/* script_program_release(): drops the caller's reference to a program */
+void script_program_release( script_program_t * iprog );
+
+/* Provided by simsh.c: runs one parsed pipeline in ctx, the same way a
+ * plain command line is run
+ */
+int simsh_exec_pipeline( simsh_ctx_t * ictx, cmd_obj * cmd, simsh_result_t * result );
+
+/* Provided by simsh.c: hands stats to the context's stats callback */
+void simsh_report_stats( simsh_ctx_t * ictx, const simsh_job_stats_t * stats );
+
+#endif /* __script_h */
@@ -0,0 +1,453 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "simsh.h"
+#include "list.h"
+#include "redirect.h"
+#include "joblimits.h"
+#include "cgroup.h"
+#include "capture.h"
+#include "childmsg.h"
+#include "parse.h"
+#include "script.h"
+
+struct simsh_ctx_t {
+    int features;  //PARSE_* mask for the context's level
+    list_t* bg_pids_list;
+    cgroup_jobs_t* cg_jobs;
+    script_state_t* script; //variables and functions
+    capture_jobs_t* capture; //background output, NULL unless capture is on
+    simsh_stats_fn report_stats; //finished background cgroup jobs
+    void* report_arg;
+    int output_fd; //where builtins write
+};
+
+
+static void watchBgProcesses(simsh_ctx_t* ctx){
+    list_t* bg_pids_list = ctx->bg_pids_list;
+    struct list_node_t* node = bg_pids_list->head;
+    while(node != NULL){
+        int status = 0;
+        int pid = node->val;
+        node = node->next;
+
+        //If waitpid returns 0, no children have changed state and the status variable is meaningless
+        if(waitpid(pid, &status, WNOHANG) == 0) continue;
+        //Jobs killed by a limit (SIGXCPU, the OOM killer) end with a signal
+        if(WIFEXITED(status) || WIFSIGNALED(status)){
+            list_remove_val(bg_pids_list, pid);
+            if(ctx->capture != NULL) capture_jobs_stage_exited(ctx->capture, pid, status);
+        }
+        //else, not the process hasn't ended yet
+    }
+    if(ctx->cg_jobs->size > 0) cgroup_jobs_reap(ctx->cg_jobs, ctx->report_stats, ctx->report_arg);
+}
+
+
+static int isJobsCmd(const cmd_obj* cmd){
+    return strcmp(cmd->argv[0], "jobs") == 0;
+}
+
+//A builtin runs in the shell only as a lone stage without redirections;
+//otherwise it is forked like any other stage (see execStage())
+static int runsInShell(const cmd_obj* cmd){
+    return cmd->next_cmd == NULL && (cmd->redirs == NULL || cmd->redirs->size == 0);
+}
+
+//Runs in the child after a setup step failed. Only write() and _exit() are
+//used from here on: if the host is multithreaded another thread may hold the
+//stdio locks, and its atexit handlers and buffers belong to the parent. The
+//message itself was built with childmsg.h for the same reason
+static void childFail(const char* message){
+    size_t len = strlen(message);
+    if(write(STDOUT_FILENO, message, len) == (ssize_t) len){
+        if(write(STDOUT_FILENO, "\n", 1) != 1) _exit(127);
+    }
+    _exit(127);
+}
+
+
+//Runs in the child: places one pipeline stage under the job's limits, wires
+//it up and execs it. in_fd/out_fd are pipe ends, or -1 when the stage
+//reads/writes the terminal. capture_fd, if not -1, takes stderr and any
+//stdout that isn't piped on. The stage's own redirections are applied after
+//the pipes, so "2>&1 |" sends stderr down the pipe as well. A jobs or ulimit
+//stage prints from here instead of exec'ing. Never returns
+static void execStage(cmd_obj* cmd, int in_fd, int out_fd, int capture_fd, const job_limits_t* limits,
+                      const char* cgroup_path, const capture_jobs_t* capture){
+    char error[SIMSH_ERROR_SIZE];
+
+    //Join the job's cgroup and take its rlimits before anything else runs
+    if(cgroup_path != NULL && cgroup_enter(cgroup_path, error, sizeof(error)) == -1){
+        childFail(error);
+    }
+    if(limits_apply_rlimits(limits, error, sizeof(error)) == -1){
+        childFail(error);
+    }
+    if(capture_fd != -1){
+        //A captured background job writes to the shell, not the terminal
+        dup2(capture_fd, STDERR_FILENO);
+        if(out_fd == -1) dup2(capture_fd, STDOUT_FILENO);
+    }
+    if(in_fd != -1){
+        //Read from the previous command
+        dup2(in_fd, STDIN_FILENO);
+    }
+    if(out_fd != -1){
+        //More commands follow, so write to the outgoing pipe
+        dup2(out_fd, STDOUT_FILENO);
+    }
+#if SIMSH_MAX_LEVEL >= 2
+    if(redir_apply(cmd->redirs, error, sizeof(error)) == -1){
+        childFail(error);
+    }
+#endif
+    //Every pipe end was created with O_CLOEXEC, so exec drops the ones this
+    //stage doesn't use; the dup2'd copies above don't carry the flag
+    if(isJobsCmd(cmd)){
+        _exit(capture_jobs_print(capture, cmd->argv, STDOUT_FILENO));
+    }
+    if(strcmp(cmd->argv[0], "ulimit") == 0){
+        _exit(limits_ulimit(cmd->argv, STDOUT_FILENO, 0));
+    }
+    execvp(cmd->argv[0], cmd->argv);
+    int err = errno;
+    error[0] = '\0';
+    childmsg_add(error, sizeof(error), "execvp(): ");
+    childmsg_add_errno(error, sizeof(error), err);
+    childFail(error);
+}
+
+static void addRusage(struct rusage* total, const struct rusage* ru){
+    timeradd(&total->ru_utime, &ru->ru_utime, &total->ru_utime);
+    timeradd(&total->ru_stime, &ru->ru_stime, &total->ru_stime);
+    //Stages run side by side, so the peak is the largest single stage
+    if(ru->ru_maxrss > total->ru_maxrss) total->ru_maxrss = ru->ru_maxrss;
+    total->ru_minflt += ru->ru_minflt;
+    total->ru_majflt += ru->ru_majflt;
+    total->ru_inblock += ru->ru_inblock;
+    total->ru_oublock += ru->ru_oublock;
+    total->ru_nvcsw += ru->ru_nvcsw;
+    total->ru_nivcsw += ru->ru_nivcsw;
+}
+
+//"cmd | cmd ..." for the jobs listing
+static void describeCmd(cmd_obj* cmd, char* buffer, size_t size){
+    size_t len = 0;
+    buffer[0] = '\0';
+    for(; cmd != NULL && len < size; cmd = cmd->next_cmd){
+        int i;
+        for(i = 0; cmd->argv[i] != NULL && len < size; i++){
+            len += snprintf(buffer + len, size - len, "%s%s", (len == 0) ? "" : " ", cmd->argv[i]);
+        }
+        if(cmd->next_cmd != NULL && len < size){
+            len += snprintf(buffer + len, size - len, " |");
+        }
+    }
+}
+
+//Waits for a foreground pid while keeping captured background jobs drained,
+//so a chatty job can't fill its pipe and stall behind the foreground one.
+//The pidfd becomes readable once the process exits
+static void drainUntilExit(simsh_ctx_t* ctx, int pid){
+    int pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if(pidfd == -1) return;
+    capture_jobs_wait(ctx->capture, pidfd, -1);
+    close(pidfd);
+}
+
+//Returns 0 on success, -1 with a message in result->error
+static int executeCmd(simsh_ctx_t* ctx, cmd_obj* cmd, simsh_result_t* result){
+    int is_background = cmd->is_background;
+
+    //Exit
+    if(strcmp(cmd->argv[0], "exit") == 0){
+        result->exit_requested = 1;
+        return 0;
+    }
+    //ulimit changes the process's own limits, which every later child inherits
+    if(strcmp(cmd->argv[0], "ulimit") == 0 && runsInShell(cmd)){
+        result->status = limits_ulimit(cmd->argv, ctx->output_fd, 1);
+        return 0;
+    }
+    //jobs reads tables that live in the shell. Piped or redirected it runs
+    //as a stage of its own (see execStage()) on the output drained here
+    int has_jobs_stage = 0;
+    cmd_obj* stage;
+    for(stage = cmd; stage != NULL; stage = stage->next_cmd){
+        if(isJobsCmd(stage)) has_jobs_stage = 1;
+    }
+    if(isJobsCmd(cmd) && runsInShell(cmd)){
+        result->status = capture_jobs_builtin(ctx->capture, cmd->argv, ctx->output_fd);
+        return 0;
+    }
+    if(has_jobs_stage && ctx->capture != NULL) capture_jobs_wait(ctx->capture, -1, 0);
+
+    //A captured job's stages all write to one pipe the shell drains
+    int capture_fds[2] = { -1, -1 };
+    if(is_background && ctx->capture != NULL && pipe2(capture_fds, O_CLOEXEC) == -1){
+        snprintf(result->error, SIMSH_ERROR_SIZE, "Error creating pipe");
+        return -1;
+    }
+
+    char* cgroup_path = NULL;
+    if(limits_use_cgroup(&cmd->limits)){
+        cgroup_path = cgroup_create(&cmd->limits, result->warning, SIMSH_ERROR_SIZE);
+    }
+
+    int num_stages = 0;
+    for(stage = cmd; stage != NULL; stage = stage->next_cmd) num_stages++;
+
+    //Create every pipe up front so the fork loop below does nothing but fork.
+    //pipes[2*i] is read by stage i+1, pipes[2*i+1] is written by stage i
+    int num_pipe_fds = 2*(num_stages - 1);
+    int pipes[num_pipe_fds + 1];
+    int pids[num_stages];
+    int i;
+    for(i = 0; i < num_stages - 1; i++){
+        if(pipe2(&pipes[2*i], O_CLOEXEC) == -1){
+            snprintf(result->error, SIMSH_ERROR_SIZE, "Error creating pipe");
+            while(--i >= 0){
+                close(pipes[2*i]);
+                close(pipes[2*i + 1]);
+            }
+            //Nothing was forked, so the cgroup is empty and its stats meaningless
+            simsh_job_stats_t unused;
+            if(cgroup_path != NULL) cgroup_finish(cgroup_path, 0, &unused);
+            if(capture_fds[0] != -1){
+                close(capture_fds[0]);
+                close(capture_fds[1]);
+            }
+            return -1;
+        }
+    }
+
+    for(i = 0, stage = cmd; stage != NULL; i++, stage = stage->next_cmd){
+        //Fork returns zero in child
+        int pid = fork();
+        if(pid == 0){
+            int in_fd = (i == 0) ? -1 : pipes[2*(i-1)];
+            int out_fd = (stage->next_cmd == NULL) ? -1 : pipes[2*i + 1];
+            execStage(stage, in_fd, out_fd, capture_fds[1], &cmd->limits, cgroup_path, ctx->capture);
+        }
+        if(pid == -1 && result->error[0] == '\0'){
+            //strerror() isn't thread-safe; the childmsg table lookup is
+            int err = errno;
+            childmsg_add(result->error, SIMSH_ERROR_SIZE, "Error forking: ");
+            childmsg_add_errno(result->error, SIMSH_ERROR_SIZE, err);
+        }
+        pids[i] = pid;
+    }
+    //What a jobs stage printed is discarded once it has exited cleanly, as
+    //if it had run in the shell; nothing has been drained since the fork
+    if(has_jobs_stage && ctx->capture != NULL){
+        for(i = 0, stage = cmd; stage != NULL; i++, stage = stage->next_cmd){
+            if(isJobsCmd(stage) && pids[i] > 0) capture_jobs_shown_by(ctx->capture, stage->argv, pids[i]);
+        }
+    }
+
+    //Don't rely on the children having joined the job's cgroup yet: a
+    //background job is reaped once the cgroup looks empty, and that must not
+    //happen before its stages are in it
+    if(cgroup_path != NULL){
+        for(i = 0; i < num_stages; i++){
+            if(pids[i] > 0) cgroup_place(cgroup_path, pids[i]);
+        }
+    }
+
+    //The parent doesn't use any of the pipe ends
+    for(i = 0; i < num_pipe_fds; i++){
+        close(pipes[i]);
+    }
+    if(capture_fds[0] != -1){
+        char command[256];
+        close(capture_fds[1]);
+        describeCmd(cmd, command, sizeof(command));
+        result->job_id = capture_jobs_add(ctx->capture, capture_fds[0], command);
+    }
+
+    result->last_pid = pids[num_stages - 1];
+    result->is_background = is_background;
+    for(i = 0; i < num_stages; i++){
+        int status;
+        struct rusage ru;
+        if(pids[i] == -1) continue;
+        if(is_background){
+            list_insert_val(ctx->bg_pids_list, pids[i]);
+        }
+        else{
+            if(ctx->capture != NULL && ctx->capture->open_fds > 0) drainUntilExit(ctx, pids[i]);
+            if(wait4(pids[i], &status, 0, &ru) != pids[i]) continue;
+            if(ctx->capture != NULL) capture_jobs_stage_exited(ctx->capture, pids[i], status);
+            addRusage(&result->rusage, &ru);
+            if(i == num_stages - 1){
+                if(WIFEXITED(status)) result->status = WEXITSTATUS(status);
+                else if(WIFSIGNALED(status)) result->status = 128 + WTERMSIG(status);
+            }
+        }
+    }
+    if(pids[num_stages - 1] == -1){
+        result->status = 127;
+    }
+    if(cgroup_path != NULL){
+        //Background cgroups are reported once simsh_reap() sees them empty
+        if(!is_background && cgroup_finish(cgroup_path, result->last_pid, &result->stats) == 0){
+            result->has_stats = 1;
+        }
+        else{
+            cgroup_jobs_add(ctx->cg_jobs, cgroup_path, result->last_pid);
+        }
+    }
+    return 0;
+}
+
+
+simsh_ctx_t * simsh_ctx_create( void )
+{
+    simsh_ctx_t * new_ctx = ( simsh_ctx_t * )malloc(sizeof(simsh_ctx_t));
+    simsh_ctx_set_level( new_ctx, SIMSH_MAX_LEVEL );
+    new_ctx->bg_pids_list = list_create();
+    new_ctx->cg_jobs = cgroup_jobs_create();
+    new_ctx->script = script_state_create();
+    new_ctx->capture = NULL;
+    new_ctx->report_stats = NULL;
+    new_ctx->report_arg = NULL;
+    new_ctx->output_fd = STDOUT_FILENO;
+    return new_ctx;
+}
+
+int simsh_ctx_set_level( simsh_ctx_t * ictx, int level )
+{
+    if( level < 1 || level > SIMSH_MAX_LEVEL )
+        return -1;
+    ictx->features = 0;
+    if( level >= 2 )
+        ictx->features |= PARSE_REDIRECT;
+    if( level >= 3 )
+        ictx->features |= PARSE_PIPE;
+    return 0;
+}
+
+int simsh_max_level( void )
+{
+    return SIMSH_MAX_LEVEL;
+}
+
+void simsh_ctx_set_stats_callback( simsh_ctx_t * ictx, simsh_stats_fn report, void * arg )
+{
+    ictx->report_stats = report;
+    ictx->report_arg = arg;
+}
+
+void simsh_ctx_set_output( simsh_ctx_t * ictx, int fd )
+{
+    ictx->output_fd = fd;
+}
+
+int simsh_ctx_set_capture( simsh_ctx_t * ictx, size_t ring_size )
+{
+    //Jobs already captured keep the ring size they were started with
+    if( ictx->capture != NULL && ictx->capture->size > 0 )
+        return -1;
+    if( ictx->capture != NULL )
+        capture_jobs_delete( ictx->capture );
+    ictx->capture = ( ring_size > 0 ) ? capture_jobs_create( ring_size ) : NULL;
+    return 0;
+}
+
+void simsh_ctx_destroy( simsh_ctx_t * ictx )
+{
+    list_delete( ictx->bg_pids_list );
+    cgroup_jobs_delete( ictx->cg_jobs );
+    script_state_delete( ictx->script );
+    if( ictx->capture != NULL )
+        capture_jobs_delete( ictx->capture );
+    free( ictx );
+}
+
+int simsh_run_line( simsh_ctx_t * ictx, const char * line, simsh_result_t * result )
+{
+    script_program_t * prog;
+    int ret;
+
+    memset( result, 0, sizeof( simsh_result_t ) );
+    ret = script_compile( line, ictx->features, &prog, result->error, SIMSH_ERROR_SIZE );
+    if( ret == SCRIPT_INCOMPLETE ) {
+        result->incomplete = 1;
+        return -1;
+    }
+    if( ret != 0 )
+        return -1;
+    ret = script_run( prog, ictx->script, ictx, result );
+    script_program_release( prog );
+    return ret;
+}
+
+int simsh_exec_pipeline( simsh_ctx_t * ictx, cmd_obj * cmd, simsh_result_t * result )
+{
+    return executeCmd( ictx, cmd, result );
+}
+
+void simsh_report_stats( simsh_ctx_t * ictx, const simsh_job_stats_t * stats )
+{
+    if( ictx->report_stats != NULL )
+        ictx->report_stats( ictx->report_arg, stats );
+}
+
+int simsh_poll( simsh_ctx_t * ictx, int fd, int timeout_ms )
+{
+    struct pollfd pfd;
+
+    if( ictx->capture != NULL )
+        return capture_jobs_wait( ictx->capture, fd, timeout_ms );
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    return poll( &pfd, 1, timeout_ms );
+}
+
+int simsh_reap( simsh_ctx_t * ictx )
+{
+    if( ictx->capture != NULL )
+        capture_jobs_wait( ictx->capture, -1, 0 );
+    watchBgProcesses( ictx );
+    return ictx->bg_pids_list->size;
+}
+
+void simsh_wait_background( simsh_ctx_t * ictx )
+{
+    struct list_node_t * node;
+    int tries;
+
+    //A captured job blocks once its pipe fills, so keep draining until
+    //every pipe is closed before waiting on the processes
+    if( ictx->capture != NULL )
+        capture_jobs_wait( ictx->capture, -1, -1 );
+
+    //Block on each job in turn rather than polling
+    for( node = ictx->bg_pids_list->head; node != NULL; node = node->next ) {
+        int status;
+        if( waitpid( node->val, &status, 0 ) == node->val && ictx->capture != NULL )
+            capture_jobs_stage_exited( ictx->capture, node->val, status );
+    }
+    list_clear( ictx->bg_pids_list );
+
+    //A cgroup can report populated for a moment after its last process is
+    //reaped. One that stays busy for a second holds something that outlived
+    //its job; it is left in place for simsh_reap() or the system to clean up
+    for( tries = 0; ictx->cg_jobs->size > 0 && tries < 1000; tries++ ) {
+        cgroup_jobs_reap( ictx->cg_jobs, ictx->report_stats, ictx->report_arg );
+        if( ictx->cg_jobs->size > 0 )
+            usleep( 1000 );
+    }
+}
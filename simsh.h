@@ -0,0 +1,126 @@
+#if !defined( __simsh_h )
+#define __simsh_h 1
+
+#include <stddef.h>
+#include <sys/resource.h>
+
+/* libsimsh: the simsh3 parser and launcher as a reusable engine.
+ *
+ * All state lives in a simsh_ctx_t; nothing is global, so several threads
+ * can each run command lines through their own context at the same time.
+ * Nothing in the library calls exit(). The process-wide state a command can
+ * touch is shared as usual: the working directory, and the rlimits changed
+ * by the ulimit builtin.
+ */
+
+typedef struct simsh_ctx_t simsh_ctx_t;
+
+#define SIMSH_ERROR_SIZE 256
+
+/* Resource usage of a job run under "run --cpu=N --mem=SIZE", read from its
+ * cgroup once the job has finished
+ */
+typedef struct {
+    int pid;                //last stage of the job
+    char name[ 64 ];        //cgroup directory, job-<shell pid>-XXXXXX
+    long long cpu_usec;     //cpu.stat usage_usec, -1 if unknown
+    long long memory_peak;  //bytes (memory.peak, else memory.current), -1 if unknown
+} simsh_job_stats_t;
+
+typedef struct {
+    int status;            //exit status of the last stage, 128+n if killed by
+                           //signal n; 0 for builtins and background jobs
+    int is_background;     //the line ended in &; status and rusage are not known yet
+    int last_pid;          //pid of the last stage, 0 if nothing was forked
+    int job_id;            //%n of a captured background job, 0 otherwise
+    int exit_requested;    //the line ran the exit builtin
+    int incomplete;        //the text ends inside an if/while/for/case/function;
+                           //append the next line and run it again
+    struct rusage rusage;  //summed over every stage of a foreground job
+    int has_stats;         //stats holds a foreground cgroup job's usage
+    simsh_job_stats_t stats;
+    char warning[ SIMSH_ERROR_SIZE ]; //set when the line ran but not quite as
+                                      //asked (e.g. run without a cgroup)
+    char error[ SIMSH_ERROR_SIZE ]; //why the line was rejected, or why a
+                                    //command in it could not be started
+} simsh_result_t;
+
+/* Called from simsh_reap() and simsh_wait_background() as each background
+ * cgroup job (and any foreground one that was still busy) finishes, and
+ * for foreground jobs other than the last one of a multi-command line
+ */
+typedef void ( * simsh_stats_fn )( void * arg, const simsh_job_stats_t * stats );
+
+/* simsh_ctx_create(): new context at the highest level compiled in */
+simsh_ctx_t * simsh_ctx_create( void );
+
+/* simsh_ctx_destroy(): frees the context without waiting for its background
+ * jobs; call simsh_wait_background() first to reap them
+ */
+void simsh_ctx_destroy( simsh_ctx_t * ictx );
+
+/* simsh_ctx_set_level(): picks the syntax the context accepts
+ * input: 1 for foreground/background jobs only, 2 to add redirection, 3 to
+ *   add pipes; operators above the level are passed on as ordinary words
+ * return value: 0 on success, -1 if the level is not compiled in
+ *   (see SIMSH_MAX_LEVEL)
+ */
+int simsh_ctx_set_level( simsh_ctx_t * ictx, int level );
+
+/* simsh_max_level(): highest level compiled into the library */
+int simsh_max_level( void );
+
+/* simsh_ctx_set_stats_callback(): where background job stats are delivered
+ * input: report may be NULL to drop them
+ */
+void simsh_ctx_set_stats_callback( simsh_ctx_t * ictx, simsh_stats_fn report, void * arg );
+
+/* simsh_ctx_set_output(): descriptor the builtins (ulimit, jobs) write to
+ * Defaults to 1. Their output is written with write(), never through the
+ * host's stdio; a builtin's redirections and pipes still apply on top.
+ */
+void simsh_ctx_set_output( simsh_ctx_t * ictx, int fd );
+
+/* simsh_ctx_set_capture(): captures the stdout and stderr of background jobs
+ * Each job started with & afterwards writes to a pipe the context drains
+ * into a ring buffer of ring_size bytes, spilling older output to a
+ * temporary file; "jobs" lists the jobs and "jobs -o %n" prints one's output.
+ * Output is only drained inside simsh_poll(), simsh_reap() and while
+ * simsh_run_line() waits for a foreground job, so an idle front end should
+ * wait for input with simsh_poll().
+ * input: ring_size in bytes, 0 to stop capturing new jobs
+ * return value: 0 on success, -1 while captured jobs are still listed
+ */
+int simsh_ctx_set_capture( simsh_ctx_t * ictx, size_t ring_size );
+
+/* simsh_poll(): waits until fd is readable, draining captured output meanwhile
+ * input: timeout_ms as for poll()
+ * return value: 1 if fd is readable, 0 on timeout, -1 on error
+ */
+int simsh_poll( simsh_ctx_t * ictx, int fd, int timeout_ms );
+
+/* simsh_run_line(): compiles and runs one command line or script
+ * The text may hold several commands separated by ';' or newlines, with
+ * if/while/until/for/case, NAME() { ... } functions and NAME=value
+ * variables; the context keeps variables and functions between calls.
+ * Foreground jobs are waited for; background jobs are tracked by the context.
+ * status and the other result fields describe the last pipeline run.
+ * A command that cannot be started (a pipe() failure, or a pipeline stage
+ * that expanded to nothing) gets status 1, and one whose last stage could
+ * not be forked status 127; the rest of the text still runs, and the last
+ * such message is left in result->error.
+ * return value: 0 if the text was run (or was empty), -1 if it was rejected,
+ *   with the reason in result->error (and result->incomplete set when more
+ *   lines are needed to close a block)
+ */
+int simsh_run_line( simsh_ctx_t * ictx, const char * line, simsh_result_t * result );
+
+/* simsh_reap(): collects background jobs that have finished, without blocking
+ * return value: number of background processes still running
+ */
+int simsh_reap( simsh_ctx_t * ictx );
+
+/* simsh_wait_background(): blocks until every background job has finished */
+void simsh_wait_background( simsh_ctx_t * ictx );
+
+#endif /* __simsh_h */
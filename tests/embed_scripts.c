@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../simsh.h"
+
+//Runs scripts through simsh_run_line() and checks what they print, their
+//status and, for the ones that must be rejected, the error.
+
+struct script_case_t {
+    const char* name;
+    const char* script;
+    int ret;               //what simsh_run_line() returns
+    int status;
+    const char* output;    //everything the script wrote to stdout
+    const char* error;     //result.error, NULL if not checked
+};
+
+static const struct script_case_t cases[] = {
+    {"if", "x=2; if test $x = 1; then echo one; elif test $x = 2; then echo two; else echo other; fi",
+     0, 0, "two\n", NULL},
+    {"else", "if false; then echo one; elif false; then echo two; else echo other; fi",
+     0, 0, "other\n", NULL},
+    {"if status", "if true; then false; fi", 0, 1, "", NULL},
+    {"while continue", "n=; while test -z $n; do n=x; echo once; continue; echo never; done; echo $n",
+     0, 0, "once\nx\n", NULL},
+    {"while break", "while true; do echo a; break; echo never; done", 0, 0, "a\n", NULL},
+    {"until", "n=; until test x$n = xdone; do echo u$n; n=done; done", 0, 0, "u\n", NULL},
+    {"until break", "until false; do echo b; break; done; echo after", 0, 0, "b\nafter\n", NULL},
+    {"nested for", "for a in 1 2; do for b in x y z; do if test $b = y; then continue; fi; echo $a$b; done; done",
+     0, 0, "1x\n1z\n2x\n2z\n", NULL},
+    {"break inner", "for a in 1 2; do for b in x y; do break; done; echo $a$b; done",
+     0, 0, "1x\n2x\n", NULL},
+    {"case", "for w in apple kiwi plum; do case $w in apple|plum) echo fruit-$w ;; k*) echo k-$w ;; esac; done",
+     0, 0, "fruit-apple\nk-kiwi\nfruit-plum\n", NULL},
+    {"case default", "case zz in a|b) echo ab ;; *) echo default ;; esac", 0, 0, "default\n", NULL},
+    {"function args", "f() { echo $# $1 $2; return 3; }; f a b; echo $?; f; echo $?",
+     0, 0, "2 a b\n3\n0\n3\n", NULL},
+    {"function for $@", "f() { for a; do echo [$a]; done; }; f x y", 0, 0, "[x]\n[y]\n", NULL},
+    {"return status", "f() { return 7; }; f", 0, 7, "", NULL},
+    {"return in for", "g() { for i in 1 2 3; do if test $i = 2; then return 5; fi; echo $i; done; echo never; }; g; echo $?",
+     0, 0, "1\n5\n", NULL},
+    {"return in nested for", "g() { for i in 1 2; do for j in a b; do return 4; done; done; }; g; g; echo $?",
+     0, 0, "4\n", NULL},
+    {"top-level return", "echo a; return 3; echo never", -1, 0, "", "return: only meaningful in a function"},
+    {"recursion limit", "r() { r; }; r; echo never", -1, 0, "", "r: maximum function nesting exceeded"},
+    {"null stage", "echo hi | $UNSET; echo $?", 0, 0, "1\n", "Invalid null command"},
+    {"function redirect", "f() { echo x; }; f > fout; echo never", -1, 0, "",
+     "f: redirections and run limits do not apply to functions"},
+    {"function limits", "f() { echo x; }; run --nofile=16 f", -1, 0, "",
+     "f: redirections and run limits do not apply to functions"},
+    {"2>", "cat nofile 2> e1; echo $?; wc -l < e1", 0, 0, "1\n1\n", NULL},
+    {"2>>", "cat nofile 2> e2; cat nofile 2>> e2; wc -l < e2", 0, 0, "2\n", NULL},
+    {"&>", "echo out &> a1; cat nofile &> a2; cat a1; wc -l < a2", 0, 0, "out\n1\n", NULL},
+    {"n>&m", "echo dup 2> d1 1>&2; cat d1", 0, 0, "dup\n", NULL},
+    {"n> file", "echo three 3> f3 1>&3; cat f3", 0, 0, "three\n", NULL},
+    {"n< file", "echo in > i1; cat 3< i1 0<&3", 0, 0, "in\n", NULL},
+    {"2>&1 |", "cat nofile 2>&1 | wc -l", 0, 0, "1\n", NULL},
+    {"n>&-", "echo closed 2> c1 1>&-; echo $?; wc -l < c1", 0, 0, "1\n1\n", NULL},
+    {">> keeps mode", "echo a > m1; chmod 600 m1; echo b >> m1; stat -c %a m1; cat m1",
+     0, 0, "600\na\nb\n", NULL},
+    {"run --nofile", "echo ulimit -n > un.sh; run --nofile=16 sh un.sh; echo ulimit -t > ut.sh; run --time=7 sh ut.sh",
+     0, 0, "16\n7\n", NULL},
+    {"ulimit", "ulimit -S -n 64; ulimit -n > u1; cat u1; ulimit -S -n 32 | cat; ulimit -n; sh un.sh",
+     0, 0, "64\n64\n64\n", NULL},
+    {"escaped semicolon", "echo a\\;b; echo c", 0, 0, "a;b\nc\n", NULL},
+    {"find -exec", "touch fa; find . -name fa -exec echo found {} ;", 0, 0, "found ./fa\n", NULL},
+    {"find -exec \\;", "find . -name fa -exec echo found {} \\; ; echo after", 0, 0, "found ./fa\nafter\n", NULL},
+    {"incomplete if", "if true; then echo x", -1, 0, "", NULL},
+    {"incomplete while", "while true; do\necho x", -1, 0, "", NULL},
+    {"incomplete for", "for a in 1 2; do", -1, 0, "", NULL},
+    {"incomplete case", "case a in a) echo a ;;", -1, 0, "", NULL},
+    {"incomplete function", "f() {\necho x", -1, 0, "", NULL},
+    {"completed", "for a in 1 2; do\necho $a\ndone", 0, 0, "1\n2\n", NULL},
+};
+
+//The incomplete cases must say so, the others must not
+static int expectIncomplete(const struct script_case_t* c){
+    return strncmp(c->name, "incomplete", 10) == 0;
+}
+
+//Runs one case with stdout going to out_fd, which is emptied first
+static int runCase(simsh_ctx_t* ctx, const struct script_case_t* c, int out_fd){
+    simsh_result_t result;
+    char output[4096];
+    ssize_t len;
+    int saved_stdout = dup(STDOUT_FILENO);
+    int ret;
+    int failed = 0;
+
+    fflush(stdout);
+    if(ftruncate(out_fd, 0) != 0 || lseek(out_fd, 0, SEEK_SET) != 0){
+        perror("output file");
+        return 1;
+    }
+    dup2(out_fd, STDOUT_FILENO);
+    ret = simsh_run_line(ctx, c->script, &result);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    len = pread(out_fd, output, sizeof(output) - 1, 0);
+    output[(len > 0) ? len : 0] = '\0';
+
+    if(ret != c->ret){
+        printf("FAIL %s: returned %d, expected %d (%s)\n", c->name, ret, c->ret, result.error);
+        failed = 1;
+    }
+    else if(ret == 0 && result.status != c->status){
+        printf("FAIL %s: status %d, expected %d\n", c->name, result.status, c->status);
+        failed = 1;
+    }
+    if(strcmp(output, c->output) != 0){
+        printf("FAIL %s: printed \"%s\", expected \"%s\"\n", c->name, output, c->output);
+        failed = 1;
+    }
+    if(c->error != NULL && strcmp(result.error, c->error) != 0){
+        printf("FAIL %s: error \"%s\", expected \"%s\"\n", c->name, result.error, c->error);
+        failed = 1;
+    }
+    if(ret == -1 && result.incomplete != expectIncomplete(c)){
+        printf("FAIL %s: incomplete is %d\n", c->name, result.incomplete);
+        failed = 1;
+    }
+    return failed;
+}
+
+//More elif branches and case arms than any fixed table would hold
+#define LONG_BRANCHES 1000
+
+static int runLongScripts(int out_fd){
+    size_t size = LONG_BRANCHES * 64 + 64;
+    char* if_script = malloc(size);
+    char* case_script = malloc(size);
+    size_t if_len, case_len;
+    int failures = 0;
+    int i;
+
+    if_len = snprintf(if_script, size, "if false; then echo 0");
+    case_len = snprintf(case_script, size, "case %d in", LONG_BRANCHES);
+    for(i = 1; i <= LONG_BRANCHES; i++){
+        if_len += snprintf(if_script + if_len, size - if_len, "; elif test %d = %d; then echo %d", i, LONG_BRANCHES, i);
+        case_len += snprintf(case_script + case_len, size - case_len, " %d) echo %d ;;", i, i);
+    }
+    snprintf(if_script + if_len, size - if_len, "; fi");
+    snprintf(case_script + case_len, size - case_len, " esac");
+
+    struct script_case_t long_if = {"long elif", if_script, 0, 0, "1000\n", NULL};
+    struct script_case_t long_case = {"long case", case_script, 0, 0, "1000\n", NULL};
+    simsh_ctx_t* ctx = simsh_ctx_create();
+    failures += runCase(ctx, &long_if, out_fd);
+    failures += runCase(ctx, &long_case, out_fd);
+    simsh_ctx_destroy(ctx);
+    free(if_script);
+    free(case_script);
+    return failures;
+}
+
+int main(int argc, char* argv[]){
+    int num_cases = sizeof(cases) / sizeof(cases[0]);
+    int failures = 0;
+    int i;
+
+    //Scripts that write files do it in a scratch directory of their own
+    char dir[] = "/tmp/simsh-scriptsXXXXXX";
+    if(mkdtemp(dir) == NULL || chdir(dir) == -1){
+        perror(dir);
+        return 1;
+    }
+    int out_fd = open(".output", O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if(out_fd == -1){
+        perror(".output");
+        return 1;
+    }
+    unlink(".output");
+
+    //A fresh context per case, so no function or variable leaks between them
+    for(i = 0; i < num_cases; i++){
+        simsh_ctx_t* ctx = simsh_ctx_create();
+        failures += runCase(ctx, &cases[i], out_fd);
+        simsh_ctx_destroy(ctx);
+    }
+    failures += runLongScripts(out_fd);
+    num_cases += 2;
+    close(out_fd);
+
+    char cleanup[64];
+    simsh_ctx_t* ctx = simsh_ctx_create();
+    simsh_result_t result;
+    snprintf(cleanup, sizeof(cleanup), "rm -r %s", dir);
+    if(chdir("/") == -1 || simsh_run_line(ctx, cleanup, &result) != 0 || result.status != 0){
+        printf("cannot remove %s\n", dir);
+    }
+    simsh_ctx_destroy(ctx);
+
+    if(failures > 0){
+        printf("FAIL: %d of %d scripts\n", failures, num_cases);
+        return 1;
+    }
+    printf("ok: %d scripts\n", num_cases);
+    return 0;
+}
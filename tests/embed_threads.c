@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "../simsh.h"
+
+//Runs pipelines through libsimsh from several threads at once, each with its
+//own context, and checks that every result carries the right exit status.
+
+#define NUM_THREADS 8
+#define LINES_PER_THREAD 200
+
+struct thread_arg_t {
+    int id;
+    const char* exit_script;  //sh script that exits with its first argument
+    int failures;
+};
+
+void* runLines(void* varg){
+    struct thread_arg_t* arg = (struct thread_arg_t*) varg;
+    simsh_ctx_t* ctx = simsh_ctx_create();
+    simsh_result_t result;
+    char line[128];
+    int i;
+
+    for(i = 0; i < LINES_PER_THREAD; i++){
+        //Exit statuses differ per thread and iteration, so mixed-up results show
+        int expected = (arg->id * 7 + i) % 100;
+        snprintf(line, sizeof(line), "echo %d | cat | sh %s %d", i, arg->exit_script, expected);
+        if(simsh_run_line(ctx, line, &result) != 0 || result.status != expected){
+            arg->failures++;
+        }
+        if(simsh_run_line(ctx, "true &", &result) != 0 || !result.is_background){
+            arg->failures++;
+        }
+    }
+    if(simsh_run_line(ctx, "| broken", &result) != -1 ||
+       strcmp(result.error, "Invalid null command") != 0){
+        arg->failures++;
+    }
+    simsh_wait_background(ctx);
+    if(simsh_reap(ctx) != 0) arg->failures++;
+    simsh_ctx_destroy(ctx);
+    return NULL;
+}
+
+int main(int argc, char* argv[]){
+    pthread_t threads[NUM_THREADS];
+    struct thread_arg_t args[NUM_THREADS];
+    int failures = 0;
+    int i;
+
+    char exit_script[] = "/tmp/simsh-exitXXXXXX";
+    int fd = mkstemp(exit_script);
+    if(fd == -1 || write(fd, "exit $1\n", 8) != 8){
+        perror(exit_script);
+        return 1;
+    }
+    close(fd);
+
+    for(i = 0; i < NUM_THREADS; i++){
+        args[i].id = i;
+        args[i].exit_script = exit_script;
+        args[i].failures = 0;
+        pthread_create(&threads[i], NULL, runLines, &args[i]);
+    }
+    for(i = 0; i < NUM_THREADS; i++){
+        pthread_join(threads[i], NULL);
+        failures += args[i].failures;
+    }
+    unlink(exit_script);
+    if(failures > 0){
+        printf("FAIL: %d wrong results\n", failures);
+        return 1;
+    }
+    printf("ok: %d threads x %d lines\n", NUM_THREADS, LINES_PER_THREAD * 2);
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "../chop_line.h"
+#include "../parse.h"
+#include "../script.h"
+
+//The compiler never runs anything; script_run() is not linked in use
+int simsh_exec_pipeline(simsh_ctx_t* ctx, cmd_obj* cmd, simsh_result_t* result){
+    return 0;
+}
+
+void simsh_report_stats(simsh_ctx_t* ctx, const simsh_job_stats_t* stats){
+}
+
+//Runs one input through the tokenizer, the parser and the script compiler
+//with every PARSE_* feature on, and describes what each made of it:
+//"parse: accept", "parse: reject: <error>", "parse: empty", and likewise
+//"script: accept|incomplete|reject: <error>"
+static void describeInput(const char* line, char* out, size_t size){
+    char error[256];
+    int len;
+
+    chopped_line_t* chop_cmd = get_chopped_line(line);
+    if(chop_cmd->num_tokens == 0){
+        len = snprintf(out, size, "parse: empty\n");
+    }
+    else{
+        cmd_obj* cmd = processCmd(chop_cmd, PARSE_REDIRECT | PARSE_PIPE, error, sizeof(error));
+        if(cmd != NULL) len = snprintf(out, size, "parse: accept\n");
+        else len = snprintf(out, size, "parse: reject: %s\n", error);
+        freeCmd(cmd);
+    }
+    free_chopped_line(chop_cmd);
+
+    script_program_t* prog = NULL;
+    int ret = script_compile(line, PARSE_REDIRECT | PARSE_PIPE, &prog, error, sizeof(error));
+    if(ret == 0) snprintf(out + len, size - len, "script: accept\n");
+    else if(ret == SCRIPT_INCOMPLETE) snprintf(out + len, size - len, "script: incomplete\n");
+    else snprintf(out + len, size - len, "script: reject: %s\n", error);
+    script_program_release(prog);
+}
+
+//libFuzzer target: only crashes and sanitizer reports count here
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size){
+    char* line = (char*) malloc(size + 1);
+    char outcome[1024];
+
+    memcpy(line, data, size);
+    line[size] = '\0';
+    describeInput(line, outcome, sizeof(outcome));
+    free(line);
+    return 0;
+}
+
+#if defined(SIMSH_FUZZ_REPLAY)
+//Without libFuzzer (e.g. a gcc -fsanitize=address build), replays the files
+//named on the command line so the corpus doubles as a regression suite. Each
+//input's outcome (see describeInput()) must match the file of the same name
+//in the --expected directory; --update rewrites those files instead.
+//
+//usage: fuzz_replay --expected DIR [--update] FILE...
+int main(int argc, char* argv[]){
+    const char* expected_dir = NULL;
+    int update = 0;
+    int failures = 0;
+    int replayed = 0;
+    int i;
+
+    for(i = 1; i < argc && strncmp(argv[i], "--", 2) == 0; i++){
+        if(strcmp(argv[i], "--expected") == 0 && i + 1 < argc) expected_dir = argv[++i];
+        else if(strcmp(argv[i], "--update") == 0) update = 1;
+        else break;
+    }
+    if(expected_dir == NULL){
+        fprintf(stderr, "usage: %s --expected DIR [--update] FILE...\n", argv[0]);
+        return 2;
+    }
+
+    for(; i < argc; i++){
+        FILE* f = fopen(argv[i], "rb");
+        if(f == NULL){
+            fprintf(stderr, "%s: cannot open\n", argv[i]);
+            return 1;
+        }
+        char buffer[65536];
+        size_t size = fread(buffer, 1, sizeof(buffer) - 1, f);
+        fclose(f);
+        buffer[size] = '\0';
+
+        char outcome[1024];
+        describeInput(buffer, outcome, sizeof(outcome));
+        replayed++;
+
+        const char* name = strrchr(argv[i], '/');
+        name = (name == NULL) ? argv[i] : name + 1;
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", expected_dir, name);
+
+        if(update){
+            f = fopen(path, "w");
+            if(f == NULL || fputs(outcome, f) == EOF){
+                fprintf(stderr, "%s: cannot write\n", path);
+                return 1;
+            }
+            fclose(f);
+            continue;
+        }
+        char expected[1024];
+        f = fopen(path, "r");
+        size = (f == NULL) ? 0 : fread(expected, 1, sizeof(expected) - 1, f);
+        if(f != NULL) fclose(f);
+        expected[size] = '\0';
+        if(f == NULL || strcmp(expected, outcome) != 0){
+            fprintf(stderr, "FAIL %s\n--- expected (%s)\n%s--- got\n%s", argv[i], path,
+                    (f == NULL) ? "missing\n" : expected, outcome);
+            failures++;
+        }
+    }
+    fprintf(stderr, "replayed %d inputs, %d failed\n", replayed, failures);
+    return (failures == 0) ? 0 : 1;
+}
+#endif
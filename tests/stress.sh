@@ -0,0 +1,135 @@
+#!/bin/bash
+#Non-interactive stress test for simsh3. Drives the shell through a fifo with
+#thousands of background jobs, deep pipelines and failing redirects, and
+#checks that its descriptor count, RSS and child list come back to where they
+#started. A second shell runs with --capture and hundreds of chatty jobs.
+#
+#usage: tests/stress.sh [shell]    (JOBS, DEPTH, ROUNDS and CAPTURE_JOBS
+#override the sizes)
+
+SHELL_BIN=${1:-./simsh3}
+JOBS=${JOBS:-2000}
+DEPTH=${DEPTH:-200}
+ROUNDS=${ROUNDS:-2000}
+RSS_SLACK_KB=${RSS_SLACK_KB:-256}
+CAPTURE_JOBS=${CAPTURE_JOBS:-300}
+CAPTURE_LINES=20000
+
+work=$(mktemp -d)
+trap 'exec 3>&-; kill $pid 2>/dev/null; rm -rf "$work"' EXIT
+
+fail(){
+    echo "FAIL: $*"
+    echo "--- last shell output:"
+    tail -n 20 "$work/out"
+    exit 1
+}
+
+#Starts the shell on a fresh fifo, with any extra arguments given
+start_shell(){
+    rm -f "$work/in"
+    mkfifo "$work/in"
+    "$SHELL_BIN" "$@" < "$work/in" > "$work/out" 2>&1 &
+    pid=$!
+    exec 3> "$work/in"
+}
+
+#Sends exit and checks the shell went away cleanly
+stop_shell(){
+    echo "exit" >&3
+    exec 3>&-
+    wait $pid
+    status=$?
+    [ $status -eq 0 ] || fail "shell exited with $status"
+}
+
+start_shell
+
+#Waits until the shell has processed everything sent so far
+sync_n=0
+sync_shell(){
+    sync_n=$((sync_n + 1))
+    echo "echo __sync_$sync_n" >&3
+    until grep -q "__sync_$sync_n\$" "$work/out"; do
+        kill -0 $pid 2>/dev/null || fail "shell died"
+        sleep 0.02
+    done
+}
+
+fd_count(){ ls /proc/$pid/fd | wc -l; }
+rss_kb(){ awk '/^VmRSS/ { print $2 }' /proc/$pid/status; }
+child_count(){ ps --ppid $pid -o pid= | wc -l; }
+
+check_fds(){
+    local now
+    now=$(fd_count)
+    [ "$now" -eq "$fds_start" ] || fail "$1: shell has $now fds open, started with $fds_start"
+}
+
+sync_shell
+fds_start=$(fd_count)
+
+#Background jobs: each must be reaped, leaving no zombies behind
+for ((i = 1; i <= JOBS; i++)); do
+    echo "true &" >&3
+    [ $((i % 200)) -eq 0 ] && sync_shell
+done
+echo "sleep 0.2" >&3
+sync_shell
+check_fds "background jobs"
+[ "$(child_count)" -eq 0 ] || fail "background jobs: $(child_count) children not reaped"
+echo "ok: $JOBS background jobs"
+
+#Deep pipelines
+line="echo deep"
+for ((i = 1; i < DEPTH; i++)); do line="$line | cat"; done
+for ((i = 1; i <= 20; i++)); do echo "$line" >&3; done
+sync_shell
+[ "$(grep -c deep "$work/out")" -eq 20 ] || fail "deep pipeline output missing"
+check_fds "deep pipelines"
+echo "ok: 20 pipelines of $DEPTH stages"
+
+#Repeated parse/launch cycles, including ones that fail, must not grow the heap
+rss_start=$(rss_kb)
+for ((i = 1; i <= ROUNDS; i++)); do
+    echo "ls /nonexistent 2>&1 | cat > /dev/null" >&3
+    echo "cat < /nonexistent" >&3
+    echo "echo x > | cat" >&3
+    [ $((i % 200)) -eq 0 ] && sync_shell
+done
+sync_shell
+check_fds "redirect rounds"
+rss_end=$(rss_kb)
+[ $((rss_end - rss_start)) -le "$RSS_SLACK_KB" ] || fail "RSS grew from ${rss_start}kB to ${rss_end}kB over $ROUNDS rounds"
+echo "ok: $ROUNDS redirect rounds, RSS ${rss_start}kB -> ${rss_end}kB"
+
+stop_shell
+echo "ok: clean exit"
+
+#Captured output: every job writes far more than its 4k ring, so most of it
+#goes through the spill files. The shell's RSS must stay near the rings'
+#total, and reading each job back must give every line and close its files
+start_shell --capture=4k
+sync_shell
+fds_start=$(fd_count)
+rss_start=$(rss_kb)
+for ((i = 1; i <= CAPTURE_JOBS; i++)); do
+    echo "seq 1 $CAPTURE_LINES &" >&3
+    [ $((i % 50)) -eq 0 ] && sync_shell
+done
+echo "sleep 0.5" >&3
+sync_shell
+[ "$(child_count)" -eq 0 ] || fail "captured jobs: $(child_count) children not reaped"
+rss_end=$(rss_kb)
+[ $((rss_end - rss_start)) -le $((CAPTURE_JOBS * 4 + RSS_SLACK_KB * 4)) ] \
+    || fail "RSS grew from ${rss_start}kB to ${rss_end}kB with $CAPTURE_JOBS captured jobs"
+lines_before=$(grep -c "^$CAPTURE_LINES\$" "$work/out")
+for ((i = 1; i <= CAPTURE_JOBS; i++)); do
+    echo "jobs -o %$i" >&3
+done
+sync_shell
+lines=$(grep -c "^$CAPTURE_LINES\$" "$work/out")
+[ $((lines - lines_before)) -eq "$CAPTURE_JOBS" ] || fail "captured output: $((lines - lines_before)) of $CAPTURE_JOBS jobs read back whole"
+check_fds "captured jobs"
+stop_shell
+echo "ok: $CAPTURE_JOBS captured jobs, RSS ${rss_start}kB -> ${rss_end}kB"